@@ -6,65 +6,76 @@
 
 uint32 FPathfindingWorker::Run()
 {
-	while (bRunThread)
+	if (FlowField.IsValid())
 	{
-		if (ThreadIsPaused) continue;
-		
-		TPair<FVector, FVector> Task;
-		//Dequeue will return false if the queue is empty.
-		while (IsWorking && TaskQueue.Dequeue(Task))
+		while (bRunThread)
 		{
-			PathFound = OctreeGraph::LazyOctreeAStar(ThreadIsPaused, Debug, ActorBoxes, MinSize, Task.Key, Task.Value, OctreeRootNode.Pin(), PathPoints);
-			FPlatformProcess::Sleep(0.01f); //I lost the source but read somewhere that a small sleep can help with the flip-flopping of threads.
-			IsWorking = false;
+			//Nothing to build until the target moves to another leaf.
+			if (!FlowField->Refresh(ThreadIsPaused, Debug))
+			{
+				WorkEvent->Wait();
+			}
 		}
+		return 0;
 	}
-	return 0;
-}
 
-void FPathfindingWorker::Stop()
-{
-	FRunnable::Stop();
-	bRunThread = false;
-	ThreadIsPaused = true;
+	//Returns null once the service stops.
+	while (const TSharedPtr<FPathfindingService::FRequest> Request = Service->WaitForRequest())
+	{
+		if (Request->Deadline > 0 && FPlatformTime::Seconds() > Request->Deadline)
+		{
+			if (Request->Graph->Debug) UE_LOG(LogTemp, Warning, TEXT("Pathfinding request expired in the queue."));
+			FPathfindingService::FResultSlot* Slot = Service->BeginResult(WorkerIndex);
+			if (Slot == nullptr) break;
 
-	TaskQueue.Empty();
-	PathPoints.Empty();
-	IsWorking = false;
-}
+			Slot->Request = Request;
+			Slot->Status = EPathfindingStatus::Expired;
+			Service->EndResult(WorkerIndex);
+			continue;
+		}
 
-void FPathfindingWorker::ContinueThread()
-{
-	TaskQueue.Empty();
-	PathPoints.Empty();
-	IsWorking = false;
-	ThreadIsPaused = false;
-}
+		//A deadline also caps the search, it returns a partial path instead of running past it.
+		FOctreePathSettings Settings = Request->Graph->PathSettings;
+		if (Request->Deadline > 0)
+		{
+			Settings.TimeBudget = FMath::Min(Settings.TimeBudget, static_cast<float>(Request->Deadline - FPlatformTime::Seconds()));
+		}
 
-void FPathfindingWorker::PauseThread()
-{
-	ThreadIsPaused = true;
-	TaskQueue.Empty();
-	PathPoints.Empty();
-	IsWorking = false;
-	
-}
+		//The agent gets every path an anytime search finds as soon as it is found, while the search goes on improving it.
+		if (Settings.Anytime)
+		{
+			Settings.OnPathImproved = [this, &Request](const TConstArrayView<FVector> Path)
+			{
+				FPathfindingService::FResultSlot* Slot = Service->BeginResult(WorkerIndex);
+				if (Slot == nullptr) return;
 
-void FPathfindingWorker::AddToQueue(const TPair<FVector, FVector>& Task, const bool MoveOnToNextTask)
-{
-	TaskQueue.Enqueue(Task);
-	
-	if (MoveOnToNextTask)
-	{
-		//IsPathfindingInProgress = false;
-		IsWorking = true;
+				Slot->Request = Request;
+				Slot->Status = EPathfindingStatus::Found;
+				Slot->Path.Append(Path);
+				Service->EndResult(WorkerIndex, false);
+			};
+		}
+
+		//The search writes into the worker's buffer, which is then traded for the slot's. Taking the slot only now keeps it free for
+		//the paths handed out meanwhile.
+		Path.Reset();
+		const bool PathFound = Request->Graph->FindPath(Request->Cancelled, Request->AgentKey, Request->Start, Request->End, Settings, Path);
+
+		FPathfindingService::FResultSlot* Slot = Service->BeginResult(WorkerIndex);
+		if (Slot == nullptr) break;
+
+		Slot->Request = Request;
+		Slot->Status = PathFound ? EPathfindingStatus::Found : EPathfindingStatus::NotFound;
+		Swap(Slot->Path, Path);
+		Service->EndResult(WorkerIndex);
 	}
+	return 0;
 }
 
-TArray<FVector> FPathfindingWorker::GetOutQueue()
+void FPathfindingWorker::Stop()
 {
-	TArray<FVector> OutPathPoints = PathPoints;
-	PathPoints.Empty();
-	
-	return OutPathPoints;
+	FRunnable::Stop();
+	bRunThread = false;
+
+	if (WorkEvent) WorkEvent->Trigger();
 }
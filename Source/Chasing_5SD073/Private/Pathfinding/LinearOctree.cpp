@@ -0,0 +1,862 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/LinearOctree.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/FileHelper.h"
+#include "Pathfinding/OctreeNode.h"
+
+namespace LinearOctree
+{
+	//Standard "magic bits" interleaving. Each step spreads the bits of the previous one twice as far apart.
+	static uint64 SpreadBits(const uint32 Value)
+	{
+		uint64 X = Value & 0x1fffff;
+		X = (X | X << 32) & 0x1f00000000ffffull;
+		X = (X | X << 16) & 0x1f0000ff0000ffull;
+		X = (X | X << 8) & 0x100f00f00f00f00full;
+		X = (X | X << 4) & 0x10c30c30c30c30c3ull;
+		X = (X | X << 2) & 0x1249249249249249ull;
+		return X;
+	}
+
+	static uint32 CompactBits(uint64 X)
+	{
+		X &= 0x1249249249249249ull;
+		X = (X ^ (X >> 2)) & 0x10c30c30c30c30c3ull;
+		X = (X ^ (X >> 4)) & 0x100f00f00f00f00full;
+		X = (X ^ (X >> 8)) & 0x1f0000ff0000ffull;
+		X = (X ^ (X >> 16)) & 0x1f00000000ffffull;
+		X = (X ^ (X >> 32)) & 0x1fffffull;
+		return static_cast<uint32>(X);
+	}
+
+	uint64 EncodeMorton(const uint32 X, const uint32 Y, const uint32 Z)
+	{
+		return SpreadBits(X) | (SpreadBits(Y) << 1) | (SpreadBits(Z) << 2);
+	}
+
+	void DecodeMorton(const uint64 Morton, uint32& OutX, uint32& OutY, uint32& OutZ)
+	{
+		OutX = CompactBits(Morton);
+		OutY = CompactBits(Morton >> 1);
+		OutZ = CompactBits(Morton >> 2);
+	}
+
+	static constexpr uint32 BakeMagic = 0x4254434F; //"OCTB"
+
+	//Bump whenever FLinearOctreeNode or the bake layout changes. Older bakes are then rejected and rebuilt.
+	static constexpr uint32 BakeVersion = 2;
+
+	//A bake is this header, followed by the nodes, the bricks and the block parents. All of them are read in place.
+	struct FBakeHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint64 GeometryHash;
+		double BoundsMin[3];
+		double BoundsMax[3];
+		float MinNodeSize;
+		int32 NodeCount;
+		int32 BrickCount;
+		uint32 Reserved;
+	};
+
+	static_assert(sizeof(FBakeHeader) % alignof(FLinearOctreeNode) == 0, "The nodes following the header would be misaligned.");
+	static_assert(sizeof(FLinearOctreeNode) == 16, "FLinearOctreeNode has implicit padding, bakes would not be deterministic.");
+	static_assert(sizeof(FLinearOctreeBrick) == 16, "FLinearOctreeBrick has implicit padding, bakes would not be deterministic.");
+
+	//Voxels of a brick that touch one of its faces, indexed by axis and side (0 is the low side).
+	static constexpr uint64 BrickFaceMasks[3][2] = {
+		{0x1111111111111111ull, 0x8888888888888888ull},
+		{0x000F000F000F000Full, 0xF000F000F000F000ull},
+		{0x000000000000FFFFull, 0xFFFF000000000000ull},
+	};
+
+	//How far the bit of a voxel moves when stepping one voxel along each axis.
+	static constexpr int32 BrickAxisShifts[3] = {1, 4, 16};
+
+	static uint32 GetBrickVoxel(const uint32 X, const uint32 Y, const uint32 Z)
+	{
+		return X | (Y << BrickLevels) | (Z << (BrickLevels * 2));
+	}
+}
+
+FLinearOctree::~FLinearOctree() = default;
+
+FLinearOctree::FLinearOctree(const FBox& InBounds, const float InMinNodeSize) : Bounds(InBounds), MinNodeSize(InMinNodeSize)
+{
+	//The root is the smallest power of 2 multiple of the min size that covers the bounds, so the leaves are exactly MinNodeSize big.
+	//That also means we don't need the padding the OctreeNode root needs.
+	const float MaxExtent = FMath::Max3(Bounds.GetSize().X, Bounds.GetSize().Y, Bounds.GetSize().Z);
+	while (LeafDepth < LinearOctree::MaxDepth && MinNodeSize * static_cast<float>(1 << LeafDepth) < MaxExtent)
+	{
+		LeafDepth++;
+	}
+
+	RootHalfSize = MinNodeSize * static_cast<float>(1 << LeafDepth) / 2.0f;
+	RootMin = Bounds.GetCenter() - FVector(RootHalfSize);
+}
+
+void FLinearOctree::Build(const FOctreeBoxIndex& ActorBoxes)
+{
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	Nodes.Reset();
+	BlockParents.Reset();
+	Bricks.Reset();
+
+	MappedRegion.Reset();
+	MappedFile.Reset();
+	BakeBuffer.Empty();
+
+	Nodes.AddDefaulted();
+	RefreshView();
+	Nodes[0].Flags = ClassifyNode(GetNodeBox(0), 0, ActorBoxes);
+
+	//Octrees too small to hold a single brick are made of nodes only.
+	const int32 BrickDepth = LeafDepth - LinearOctree::BrickLevels;
+
+	//Breadth first, so the nodes of one level end up next to each other in the pool.
+	//Subdivide() appends to Nodes, which is why this is an index loop and no references are kept.
+	for (int32 i = 0; i < Nodes.Num(); i++)
+	{
+		if (!Nodes[i].IsDivisible()) continue;
+
+		if (Nodes[i].GetDepth() == BrickDepth)
+		{
+			MakeBrick(i, ActorBoxes);
+		}
+		else
+		{
+			Subdivide(i, ActorBoxes);
+		}
+	}
+
+	Nodes.Shrink();
+	BlockParents.Shrink();
+	Bricks.Shrink();
+	RefreshView();
+}
+
+void FLinearOctree::RefreshView()
+{
+	NodeData = Nodes.GetData();
+	BrickData = Bricks.GetData();
+	BlockParentData = BlockParents.GetData();
+	NodeCount = Nodes.Num();
+	BrickCount = Bricks.Num();
+}
+
+void FLinearOctree::Subdivide(const uint32 NodeIndex, const FOctreeBoxIndex& ActorBoxes)
+{
+	const uint32 First = Nodes.Num();
+	const uint64 ParentCode = Nodes[NodeIndex].LocationCode;
+	const int32 ChildDepth = Nodes[NodeIndex].GetDepth() + 1;
+
+	Nodes[NodeIndex].FirstChild = First;
+	BlockParents.Add(NodeIndex);
+	Nodes.AddDefaulted(8);
+	RefreshView();
+
+	for (uint32 i = 0; i < 8; i++)
+	{
+		FLinearOctreeNode& Child = Nodes[First + i];
+		Child.LocationCode = (ParentCode << 3) | i;
+		Child.Flags = ClassifyNode(GetNodeBox(First + i), ChildDepth, ActorBoxes);
+	}
+}
+
+void FLinearOctree::MakeBrick(const uint32 NodeIndex, const FOctreeBoxIndex& ActorBoxes)
+{
+	const FVector BrickMin = GetNodeBox(NodeIndex).Min;
+	const FVector VoxelExtent = FVector(MinNodeSize / 2.0f);
+	uint64 OccupiedVoxels = 0;
+
+	for (uint32 Z = 0; Z < LinearOctree::BrickSize; Z++)
+	{
+		for (uint32 Y = 0; Y < LinearOctree::BrickSize; Y++)
+		{
+			for (uint32 X = 0; X < LinearOctree::BrickSize; X++)
+			{
+				const FVector VoxelCenter = BrickMin + (FVector(X, Y, Z) + 0.5) * MinNodeSize;
+				if (ActorBoxes.Classify(FBox(VoxelCenter - VoxelExtent, VoxelCenter + VoxelExtent)) != FOctreeBoxIndex::EOverlap::None)
+				{
+					OccupiedVoxels |= 1ull << LinearOctree::GetBrickVoxel(X, Y, Z);
+				}
+			}
+		}
+	}
+
+	//A brick with nothing free in it is just an occupied leaf.
+	if (OccupiedVoxels == MAX_uint64)
+	{
+		Nodes[NodeIndex].Flags = FLinearOctreeNode::Occupied;
+		return;
+	}
+
+	Nodes[NodeIndex].Flags = FLinearOctreeNode::Occupied | FLinearOctreeNode::Brick;
+	Nodes[NodeIndex].FirstChild = Bricks.Num();
+
+	FLinearOctreeBrick& Brick = Bricks.AddDefaulted_GetRef();
+	Brick.OccupiedVoxels = OccupiedVoxels;
+	Brick.Node = NodeIndex;
+	RefreshView();
+}
+
+bool FLinearOctree::SaveBake(const FString& FilePath, const uint64 GeometryHash) const
+{
+	if (NodeCount == 0)
+	{
+		return false;
+	}
+
+	LinearOctree::FBakeHeader Header;
+	FMemory::Memzero(Header);
+	Header.Magic = LinearOctree::BakeMagic;
+	Header.Version = LinearOctree::BakeVersion;
+	Header.GeometryHash = GeometryHash;
+	Header.MinNodeSize = MinNodeSize;
+	Header.NodeCount = NodeCount;
+	Header.BrickCount = BrickCount;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		Header.BoundsMin[Axis] = Bounds.Min[Axis];
+		Header.BoundsMax[Axis] = Bounds.Max[Axis];
+	}
+
+	const int32 BlockCount = (NodeCount - 1) / 8;
+	const int32 NodeBytes = NodeCount * static_cast<int32>(sizeof(FLinearOctreeNode));
+	const int32 BrickBytes = BrickCount * static_cast<int32>(sizeof(FLinearOctreeBrick));
+	const int32 BlockBytes = BlockCount * static_cast<int32>(sizeof(uint32));
+
+	TArray<uint8> Buffer;
+	Buffer.Reserve(sizeof(Header) + NodeBytes + BrickBytes + BlockBytes);
+	Buffer.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+	Buffer.Append(reinterpret_cast<const uint8*>(NodeData), NodeBytes);
+	Buffer.Append(reinterpret_cast<const uint8*>(BrickData), BrickBytes);
+	Buffer.Append(reinterpret_cast<const uint8*>(BlockParentData), BlockBytes);
+
+	return FFileHelper::SaveArrayToFile(Buffer, *FilePath);
+}
+
+bool FLinearOctree::LoadBake(const FString& FilePath, const uint64 GeometryHash)
+{
+	auto ReleaseBake = [this]()
+	{
+		NodeData = nullptr;
+		BrickData = nullptr;
+		BlockParentData = nullptr;
+		NodeCount = 0;
+		BrickCount = 0;
+		MappedRegion.Reset();
+		MappedFile.Reset();
+		BakeBuffer.Empty();
+	};
+
+	ReleaseBake();
+	Nodes.Empty();
+	BlockParents.Empty();
+	Bricks.Empty();
+
+	const uint8* Data = nullptr;
+	int64 Size = 0;
+
+	MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*FilePath));
+	if (MappedFile.IsValid())
+	{
+		MappedRegion.Reset(MappedFile->MapRegion());
+		if (MappedRegion.IsValid())
+		{
+			Data = MappedRegion->GetMappedPtr();
+			Size = MappedRegion->GetMappedSize();
+		}
+	}
+
+	//Not every platform can map files (neither can pak files). Reading it whole is still a single allocation for the entire octree.
+	if (Data == nullptr)
+	{
+		LLM_SCOPE_BYTAG(OctreeNode);
+
+		if (!FFileHelper::LoadFileToArray(BakeBuffer, *FilePath, FILEREAD_Silent))
+		{
+			ReleaseBake();
+			return false;
+		}
+
+		Data = BakeBuffer.GetData();
+		Size = BakeBuffer.Num();
+	}
+
+	LinearOctree::FBakeHeader Header;
+	if (Size < static_cast<int64>(sizeof(Header)))
+	{
+		ReleaseBake();
+		return false;
+	}
+	FMemory::Memcpy(&Header, Data, sizeof(Header));
+
+	const int64 BlockCount = (Header.NodeCount - 1) / 8;
+	const int64 ExpectedSize = sizeof(Header) + Header.NodeCount * static_cast<int64>(sizeof(FLinearOctreeNode)) +
+		Header.BrickCount * static_cast<int64>(sizeof(FLinearOctreeBrick)) + BlockCount * sizeof(uint32);
+	const FVector BakedMin = FVector(Header.BoundsMin[0], Header.BoundsMin[1], Header.BoundsMin[2]);
+	const FVector BakedMax = FVector(Header.BoundsMax[0], Header.BoundsMax[1], Header.BoundsMax[2]);
+
+	if (Header.Magic != LinearOctree::BakeMagic || Header.Version != LinearOctree::BakeVersion || Header.GeometryHash != GeometryHash ||
+		Header.MinNodeSize != MinNodeSize || !BakedMin.Equals(Bounds.Min) || !BakedMax.Equals(Bounds.Max) ||
+		Header.NodeCount <= 0 || (Header.NodeCount - 1) % 8 != 0 || Header.BrickCount < 0 || Size != ExpectedSize)
+	{
+		ReleaseBake();
+		return false;
+	}
+
+	NodeData = reinterpret_cast<const FLinearOctreeNode*>(Data + sizeof(Header));
+	BrickData = reinterpret_cast<const FLinearOctreeBrick*>(NodeData + Header.NodeCount);
+	BlockParentData = reinterpret_cast<const uint32*>(BrickData + Header.BrickCount);
+	NodeCount = Header.NodeCount;
+	BrickCount = Header.BrickCount;
+	return true;
+}
+
+uint64 FLinearOctree::HashGeometry(const FBox& Bounds, const float MinNodeSize, const TArray<FBox>& ActorBoxes)
+{
+	//The overlaps don't come back in a stable order, and the built octree does not depend on it either.
+	TArray<FBox> SortedBoxes = ActorBoxes;
+	SortedBoxes.Sort([](const FBox& A, const FBox& B)
+	{
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (A.Min[Axis] != B.Min[Axis]) return A.Min[Axis] < B.Min[Axis];
+		}
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (A.Max[Axis] != B.Max[Axis]) return A.Max[Axis] < B.Max[Axis];
+		}
+		return false;
+	});
+
+	TArray<double> Values;
+	Values.Reserve(8 + SortedBoxes.Num() * 6);
+	Values.Add(LinearOctree::BakeVersion);
+	Values.Add(MinNodeSize);
+
+	auto AddBox = [&Values](const FBox& Box)
+	{
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			Values.Add(Box.Min[Axis]);
+			Values.Add(Box.Max[Axis]);
+		}
+	};
+
+	AddBox(Bounds);
+	for (const FBox& Box : SortedBoxes)
+	{
+		AddBox(Box);
+	}
+
+	return CityHash64(reinterpret_cast<const char*>(Values.GetData()), static_cast<uint32>(Values.Num() * sizeof(double)));
+}
+
+uint8 FLinearOctree::ClassifyNode(const FBox& NodeBox, const int32 Depth, const FOctreeBoxIndex& ActorBoxes) const
+{
+	switch (ActorBoxes.Classify(NodeBox))
+	{
+	case FOctreeBoxIndex::EOverlap::None: return 0;
+	//Completely inside an object, there is nothing to find by dividing it.
+	case FOctreeBoxIndex::EOverlap::Inside: return FLinearOctreeNode::Occupied;
+	default: return FLinearOctreeNode::Occupied | (Depth < LeafDepth ? FLinearOctreeNode::Divisible : 0);
+	}
+}
+
+void FLinearOctree::GetCellCoordinates(const uint32 NodeIndex, uint32 (&OutCoordinates)[3], int32& OutDepth) const
+{
+	if (!IsVoxel(NodeIndex))
+	{
+		const FLinearOctreeNode& Node = NodeData[NodeIndex];
+		OutDepth = Node.GetDepth();
+		LinearOctree::DecodeMorton(Node.GetMorton(), OutCoordinates[0], OutCoordinates[1], OutCoordinates[2]);
+		return;
+	}
+
+	const uint32 BrickIndex = (NodeIndex - NodeCount) / LinearOctree::VoxelsPerBrick;
+	const uint32 Voxel = (NodeIndex - NodeCount) % LinearOctree::VoxelsPerBrick;
+
+	LinearOctree::DecodeMorton(NodeData[BrickData[BrickIndex].Node].GetMorton(), OutCoordinates[0], OutCoordinates[1], OutCoordinates[2]);
+	OutDepth = LeafDepth;
+
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		OutCoordinates[Axis] = (OutCoordinates[Axis] << LinearOctree::BrickLevels) | ((Voxel >> (Axis * LinearOctree::BrickLevels)) & (LinearOctree::BrickSize - 1));
+	}
+}
+
+FVector FLinearOctree::GetNodeCenter(const uint32 NodeIndex) const
+{
+	uint32 Coordinates[3];
+	int32 Depth;
+	GetCellCoordinates(NodeIndex, Coordinates, Depth);
+
+	const float HalfSize = RootHalfSize / static_cast<float>(1 << Depth);
+	return RootMin + FVector(Coordinates[0] * 2 + 1, Coordinates[1] * 2 + 1, Coordinates[2] * 2 + 1) * HalfSize;
+}
+
+float FLinearOctree::GetNodeHalfSize(const uint32 NodeIndex) const
+{
+	return IsVoxel(NodeIndex) ? MinNodeSize / 2.0f : RootHalfSize / static_cast<float>(1 << NodeData[NodeIndex].GetDepth());
+}
+
+FBox FLinearOctree::GetNodeBox(const uint32 NodeIndex) const
+{
+	const FVector Center = GetNodeCenter(NodeIndex);
+	const FVector Extent = FVector(GetNodeHalfSize(NodeIndex));
+	return FBox(Center - Extent, Center + Extent);
+}
+
+bool FLinearOctree::IsOccupied(const uint32 NodeIndex) const
+{
+	if (!IsVoxel(NodeIndex))
+	{
+		return NodeData[NodeIndex].IsOccupied();
+	}
+
+	const uint32 Voxel = (NodeIndex - NodeCount) % LinearOctree::VoxelsPerBrick;
+	return ((BrickData[(NodeIndex - NodeCount) / LinearOctree::VoxelsPerBrick].OccupiedVoxels >> Voxel) & 1) != 0;
+}
+
+uint32 FLinearOctree::GetParent(const uint32 NodeIndex) const
+{
+	if (IsVoxel(NodeIndex))
+	{
+		return BrickData[(NodeIndex - NodeCount) / LinearOctree::VoxelsPerBrick].Node;
+	}
+
+	return NodeIndex == 0 ? LinearOctree::InvalidIndex : BlockParentData[(NodeIndex - 1) / 8];
+}
+
+bool FLinearOctree::HasLineOfSight(const FVector& From, const FVector& To, const float Radius) const
+{
+	FOctreeRaycastHit Hit;
+	if (TraceSegment(From, To, Hit))
+	{
+		return false;
+	}
+
+	if (Radius <= 0)
+	{
+		return true;
+	}
+
+	FVector Side, Up;
+	(To - From).GetSafeNormal().FindBestAxisVectors(Side, Up);
+
+	for (const FVector& Offset : {Side * Radius, Side * -Radius, Up * Radius, Up * -Radius})
+	{
+		if (TraceSegment(From + Offset, To + Offset, Hit))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FLinearOctree::Raycast(const FVector& From, const FVector& To, const float Radius, FOctreeRaycastHit& OutHit) const
+{
+	OutHit = FOctreeRaycastHit();
+	TraceSegment(From, To, OutHit);
+
+	if (Radius <= 0)
+	{
+		return OutHit.Blocked;
+	}
+
+	//Same 4 offset segments as HasLineOfSight(), but all of them are walked, the earliest hit is the one that counts.
+	FVector Side, Up;
+	(To - From).GetSafeNormal().FindBestAxisVectors(Side, Up);
+
+	for (const FVector& Offset : {Side * Radius, Side * -Radius, Up * Radius, Up * -Radius})
+	{
+		FOctreeRaycastHit OffsetHit;
+		if (TraceSegment(From + Offset, To + Offset, OffsetHit) && OffsetHit.Time < OutHit.Time)
+		{
+			OutHit = OffsetHit;
+		}
+	}
+
+	//Where the center of the sphere is when it hits, not where the offset segment does.
+	OutHit.Location = From + (To - From) * OutHit.Time;
+	return OutHit.Blocked;
+}
+
+bool FLinearOctree::TraceSegment(const FVector& From, const FVector& To, FOctreeRaycastHit& OutHit) const
+{
+	const FVector Delta = To - From;
+	const double Length = Delta.Size();
+
+	//Steps a sliver of the min size past every exit point, so the next descent lands in the next cell.
+	const double Nudge = Length > UE_KINDA_SMALL_NUMBER ? MinNodeSize * 0.01 / Length : 2;
+
+	//Where the segment entered the current cell.
+	double Entry = 0;
+
+	for (double T = 0; T <= 1;)
+	{
+		//Leaving the octree counts as a hit, with no cell.
+		const uint32 Cell = FindCell(From + Delta * T);
+		if (Cell == LinearOctree::InvalidIndex || IsOccupied(Cell))
+		{
+			OutHit.Blocked = true;
+			OutHit.Cell = Cell;
+			OutHit.Time = static_cast<float>(Entry);
+			OutHit.Location = From + Delta * Entry;
+			return true;
+		}
+
+		const FBox Box = GetNodeBox(Cell);
+		double Exit = 1;
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (Delta[Axis] > 0)
+			{
+				Exit = FMath::Min(Exit, (Box.Max[Axis] - From[Axis]) / Delta[Axis]);
+			}
+			else if (Delta[Axis] < 0)
+			{
+				Exit = FMath::Min(Exit, (Box.Min[Axis] - From[Axis]) / Delta[Axis]);
+			}
+		}
+
+		Entry = FMath::Max(Exit, T);
+		T = Entry + Nudge;
+	}
+
+	return false;
+}
+
+uint32 FLinearOctree::FindCell(const FVector& Location) const
+{
+	if (NodeCount == 0)
+	{
+		return LinearOctree::InvalidIndex;
+	}
+
+	const FVector RootMax = RootMin + FVector(RootHalfSize * 2.0f);
+	if (Location.X < RootMin.X || Location.Y < RootMin.Y || Location.Z < RootMin.Z ||
+		Location.X > RootMax.X || Location.Y > RootMax.Y || Location.Z > RootMax.Z)
+	{
+		return LinearOctree::InvalidIndex;
+	}
+
+	uint32 Index = 0;
+	FVector Center = RootMin + FVector(RootHalfSize);
+	float HalfSize = RootHalfSize;
+
+	while (!NodeData[Index].IsLeaf() && !NodeData[Index].IsBrick())
+	{
+		const uint32 ChildIndex = (Location.X >= Center.X ? 1 : 0) | (Location.Y >= Center.Y ? 2 : 0) | (Location.Z >= Center.Z ? 4 : 0);
+
+		HalfSize *= 0.5f;
+		Center.X += ChildIndex & 1 ? HalfSize : -HalfSize;
+		Center.Y += ChildIndex & 2 ? HalfSize : -HalfSize;
+		Center.Z += ChildIndex & 4 ? HalfSize : -HalfSize;
+
+		Index = NodeData[Index].FirstChild + ChildIndex;
+	}
+
+	if (!NodeData[Index].IsBrick())
+	{
+		return Index;
+	}
+
+	const FVector VoxelCoordinates = (Location - (Center - FVector(HalfSize))) / MinNodeSize;
+	const int32 MaxVoxelCoordinate = LinearOctree::BrickSize - 1;
+
+	const uint32 Voxel = LinearOctree::GetBrickVoxel(FMath::Clamp(FMath::FloorToInt32(VoxelCoordinates.X), 0, MaxVoxelCoordinate),
+	                                                 FMath::Clamp(FMath::FloorToInt32(VoxelCoordinates.Y), 0, MaxVoxelCoordinate),
+	                                                 FMath::Clamp(FMath::FloorToInt32(VoxelCoordinates.Z), 0, MaxVoxelCoordinate));
+
+	return GetVoxelIndex(NodeData[Index].FirstChild, Voxel);
+}
+
+uint32 FLinearOctree::FindLeaf(const FVector& Location, const bool LookingForNeighbor) const
+{
+	const uint32 Cell = FindCell(Location);
+	if (Cell == LinearOctree::InvalidIndex || !IsOccupied(Cell))
+	{
+		return Cell;
+	}
+
+	if (LookingForNeighbor)
+	{
+		return LinearOctree::InvalidIndex;
+	}
+
+	if (IsVoxel(Cell))
+	{
+		//Same as for occupied leaves below, but the whole brick counts as siblings. A brick always has at least one free voxel.
+		const uint32 BrickIndex = (Cell - NodeCount) / LinearOctree::VoxelsPerBrick;
+		uint32 ClosestUnoccupied = (Cell - NodeCount) % LinearOctree::VoxelsPerBrick;
+		double ClosestDistance = TNumericLimits<double>::Max();
+
+		for (uint64 Remaining = ~BrickData[BrickIndex].OccupiedVoxels; Remaining != 0; Remaining &= Remaining - 1)
+		{
+			const uint32 FreeVoxel = static_cast<uint32>(FMath::CountTrailingZeros64(Remaining));
+			const double Distance = FVector::DistSquared(GetNodeCenter(GetVoxelIndex(BrickIndex, FreeVoxel)), Location);
+			if (Distance <= ClosestDistance)
+			{
+				ClosestDistance = Distance;
+				ClosestUnoccupied = FreeVoxel;
+			}
+		}
+
+		return GetVoxelIndex(BrickIndex, ClosestUnoccupied);
+	}
+
+	//Same reasoning as at the bottom of OctreeNode::LazyDivideAndFindNode(): we bled into an occupied node, so we take the closest free
+	//sibling. If there is none, we let the occupied node pass, its neighbors will still be free.
+	const uint32 Parent = GetParent(Cell);
+	if (Parent == LinearOctree::InvalidIndex)
+	{
+		return Cell;
+	}
+
+	uint32 ClosestUnoccupied = LinearOctree::InvalidIndex;
+	double ClosestDistance = TNumericLimits<double>::Max();
+	const uint32 FirstSibling = NodeData[Parent].FirstChild;
+
+	for (uint32 i = FirstSibling; i < FirstSibling + 8; i++)
+	{
+		//Bricks are partly free, but none of it is the closest part for sure. They are skipped like any other occupied sibling.
+		if (NodeData[i].IsOccupied()) continue;
+
+		const double Distance = FVector::DistSquared(GetNodeCenter(i), Location);
+		if (Distance <= ClosestDistance)
+		{
+			ClosestDistance = Distance;
+			ClosestUnoccupied = i;
+		}
+	}
+
+	return ClosestUnoccupied != LinearOctree::InvalidIndex ? ClosestUnoccupied : Cell;
+}
+
+void FLinearOctree::FindNearestFreeCells(const FVector& Location, const float MaxRadius, const int32 Count, TArray<uint32>& OutCells) const
+{
+	if (NodeCount == 0 || Count <= 0)
+	{
+		return;
+	}
+
+	struct FEntry
+	{
+		double DistanceSquared;
+		uint32 Cell;
+
+		bool operator<(const FEntry& Other) const { return DistanceSquared < Other.DistanceSquared; }
+	};
+
+	TArray<FEntry, TInlineAllocator<64>> Heap;
+	const double MaxDistanceSquared = FMath::Square(static_cast<double>(MaxRadius));
+
+	auto Push = [&](const uint32 Cell)
+	{
+		//Nothing free in there, not worth a place in the heap.
+		if (!IsVoxel(Cell) && NodeData[Cell].IsLeaf() && NodeData[Cell].IsOccupied()) return;
+
+		const double DistanceSquared = GetNodeBox(Cell).ComputeSquaredDistanceToPoint(Location);
+		if (DistanceSquared <= MaxDistanceSquared)
+		{
+			Heap.HeapPush({DistanceSquared, Cell});
+		}
+	};
+
+	Push(0);
+	const int32 FirstCell = OutCells.Num();
+
+	//A node is never further than anything inside it, so a free cell that comes out of the heap is closer than every one still in it.
+	while (!Heap.IsEmpty() && OutCells.Num() - FirstCell < Count)
+	{
+		FEntry Entry;
+		Heap.HeapPop(Entry, EAllowShrinking::No);
+
+		//Only free voxels and free leaves are ever pushed.
+		if (IsVoxel(Entry.Cell) || NodeData[Entry.Cell].IsLeaf())
+		{
+			OutCells.Add(Entry.Cell);
+			continue;
+		}
+
+		const FLinearOctreeNode& Node = NodeData[Entry.Cell];
+		if (Node.IsBrick())
+		{
+			for (uint64 Remaining = ~BrickData[Node.FirstChild].OccupiedVoxels; Remaining != 0; Remaining &= Remaining - 1)
+			{
+				Push(GetVoxelIndex(Node.FirstChild, static_cast<uint32>(FMath::CountTrailingZeros64(Remaining))));
+			}
+			continue;
+		}
+
+		for (uint32 Child = Node.FirstChild; Child < Node.FirstChild + 8; Child++)
+		{
+			Push(Child);
+		}
+	}
+}
+
+void FLinearOctree::LabelComponents()
+{
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	CellComponents.Init(LinearOctree::InvalidIndex, NumCells());
+	ComponentCount = 0;
+
+	TArray<uint32> Stack;
+	TArray<uint32> Neighbors;
+
+	for (uint32 Cell = 0; Cell < static_cast<uint32>(NumCells()); Cell++)
+	{
+		const bool IsFreeLeaf = IsVoxel(Cell) || NodeData[Cell].IsLeaf();
+		if (!IsFreeLeaf || IsOccupied(Cell) || CellComponents[Cell] != LinearOctree::InvalidIndex) continue;
+
+		//Everything reachable from the first unlabelled free cell is one component. Neighbors are always free.
+		const uint32 Component = ComponentCount++;
+		CellComponents[Cell] = Component;
+		Stack.Add(Cell);
+
+		while (!Stack.IsEmpty())
+		{
+			const uint32 Current = Stack.Pop(EAllowShrinking::No);
+
+			Neighbors.Reset();
+			GetNeighbors(Current, Neighbors);
+
+			for (const uint32 Neighbor : Neighbors)
+			{
+				if (CellComponents[Neighbor] != LinearOctree::InvalidIndex) continue;
+
+				CellComponents[Neighbor] = Component;
+				Stack.Add(Neighbor);
+			}
+		}
+	}
+}
+
+uint32 FLinearOctree::DescendTo(const uint32 X, const uint32 Y, const uint32 Z, const int32 Depth) const
+{
+	uint32 Index = 0;
+	int32 Level = 1;
+
+	for (; Level <= Depth && !NodeData[Index].IsLeaf() && !NodeData[Index].IsBrick(); Level++)
+	{
+		const int32 Shift = Depth - Level;
+		const uint32 ChildIndex = ((X >> Shift) & 1) | (((Y >> Shift) & 1) << 1) | (((Z >> Shift) & 1) << 2);
+		Index = NodeData[Index].FirstChild + ChildIndex;
+	}
+
+	//Only voxels look for voxels. Anything bigger stops at the brick and gathers the voxels on its face.
+	if (NodeData[Index].IsBrick() && Depth == LeafDepth)
+	{
+		constexpr uint32 LocalMask = LinearOctree::BrickSize - 1;
+		return GetVoxelIndex(NodeData[Index].FirstChild, LinearOctree::GetBrickVoxel(X & LocalMask, Y & LocalMask, Z & LocalMask));
+	}
+
+	return Index;
+}
+
+void FLinearOctree::GetNeighbors(const uint32 NodeIndex, TArray<uint32>& OutNeighbors) const
+{
+	uint32 Coordinates[3];
+	int32 Depth;
+	GetCellCoordinates(NodeIndex, Coordinates, Depth);
+	const uint32 CoordinateLimit = 1u << Depth;
+
+	//Voxels find the free voxels next to them in the same brick straight from the mask. Only the faces on the border of the brick need a descent.
+	uint64 VoxelBit = 0;
+	if (IsVoxel(NodeIndex))
+	{
+		const uint32 BrickIndex = (NodeIndex - NodeCount) / LinearOctree::VoxelsPerBrick;
+		VoxelBit = 1ull << ((NodeIndex - NodeCount) % LinearOctree::VoxelsPerBrick);
+
+		uint64 InsideNeighbors = 0;
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			//A voxel on the high face shifted up would wrap into the next row, so those are masked out first, same for the low face.
+			InsideNeighbors |= (VoxelBit & ~LinearOctree::BrickFaceMasks[Axis][1]) << LinearOctree::BrickAxisShifts[Axis];
+			InsideNeighbors |= (VoxelBit & ~LinearOctree::BrickFaceMasks[Axis][0]) >> LinearOctree::BrickAxisShifts[Axis];
+		}
+
+		for (uint64 Remaining = InsideNeighbors & ~BrickData[BrickIndex].OccupiedVoxels; Remaining != 0; Remaining &= Remaining - 1)
+		{
+			OutNeighbors.Add(GetVoxelIndex(BrickIndex, static_cast<uint32>(FMath::CountTrailingZeros64(Remaining))));
+		}
+	}
+
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		for (const int32 Direction : {-1, 1})
+		{
+			if (VoxelBit != 0 && (VoxelBit & LinearOctree::BrickFaceMasks[Axis][Direction > 0 ? 1 : 0]) == 0) continue;
+
+			uint32 NeighborCoordinates[3] = {Coordinates[0], Coordinates[1], Coordinates[2]};
+
+			if (Direction < 0)
+			{
+				if (NeighborCoordinates[Axis] == 0) continue;
+				NeighborCoordinates[Axis]--;
+			}
+			else
+			{
+				if (NeighborCoordinates[Axis] + 1 >= CoordinateLimit) continue;
+				NeighborCoordinates[Axis]++;
+			}
+
+			//Either a same sized node or a bigger leaf. If it is the same size but divided, its children facing us are the neighbors.
+			const uint32 Neighbor = DescendTo(NeighborCoordinates[0], NeighborCoordinates[1], NeighborCoordinates[2], Depth);
+			GatherFaceLeaves(Neighbor, Axis, Direction > 0 ? 0 : 1, OutNeighbors);
+		}
+	}
+}
+
+void FLinearOctree::GatherFaceLeaves(const uint32 NodeIndex, const int32 Axis, const uint32 Side, TArray<uint32>& OutLeaves) const
+{
+	if (IsVoxel(NodeIndex))
+	{
+		if (!IsOccupied(NodeIndex))
+		{
+			OutLeaves.Add(NodeIndex);
+		}
+		return;
+	}
+
+	const FLinearOctreeNode& Node = NodeData[NodeIndex];
+
+	if (Node.IsBrick())
+	{
+		const uint64 FreeFaceVoxels = ~BrickData[Node.FirstChild].OccupiedVoxels & LinearOctree::BrickFaceMasks[Axis][Side];
+		for (uint64 Remaining = FreeFaceVoxels; Remaining != 0; Remaining &= Remaining - 1)
+		{
+			OutLeaves.Add(GetVoxelIndex(Node.FirstChild, static_cast<uint32>(FMath::CountTrailingZeros64(Remaining))));
+		}
+		return;
+	}
+
+	if (Node.IsLeaf())
+	{
+		if (!Node.IsOccupied())
+		{
+			OutLeaves.Add(NodeIndex);
+		}
+		return;
+	}
+
+	for (uint32 i = 0; i < 8; i++)
+	{
+		if (((i >> Axis) & 1) == Side)
+		{
+			GatherFaceLeaves(Node.FirstChild + i, Axis, Side, OutLeaves);
+		}
+	}
+}
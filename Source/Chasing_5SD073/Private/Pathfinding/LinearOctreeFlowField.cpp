@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/LinearOctreeFlowField.h"
+
+FLinearOctreeFlowField::FLinearOctreeFlowField(const FLinearOctree& InOctree) : Octree(InOctree)
+{
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	//Sized once here, so the agents never read a buffer that is still growing.
+	for (FField& Field : Fields)
+	{
+		Field.Next.SetNumUninitialized(Octree.NumCells());
+		Field.Distance.SetNumUninitialized(Octree.NumCells());
+		Field.CellStamp.SetNumZeroed(Octree.NumCells());
+	}
+}
+
+void FLinearOctreeFlowField::SetTarget(const FVector& InTargetLocation)
+{
+	FScopeLock Lock(&TargetLock);
+	TargetLocation = InTargetLocation;
+	HasTarget = true;
+
+	if (WakeEvent != nullptr)
+	{
+		WakeEvent->Trigger();
+	}
+}
+
+void FLinearOctreeFlowField::SetWakeEvent(FEvent* Event)
+{
+	FScopeLock Lock(&TargetLock);
+	WakeEvent = Event;
+}
+
+bool FLinearOctreeFlowField::Refresh(const std::atomic<bool>& ThreadIsPaused, const bool& Debug)
+{
+	//Only this thread changes FrontField, so reading it needs no lock.
+	FField& Back = Fields[1 - FrontField];
+
+	if (!Building)
+	{
+		FVector Target;
+		{
+			FScopeLock Lock(&TargetLock);
+			if (!HasTarget) return false;
+			Target = TargetLocation;
+		}
+
+		const uint32 TargetCell = Octree.FindLeaf(Target);
+		if (TargetCell == LinearOctree::InvalidIndex) return false;
+
+		//Still in the same leaf, the field would come out the same.
+		const FField& Front = Fields[FrontField];
+		if (Front.Stamp != 0 && Front.TargetCell == TargetCell) return false;
+
+		if (++Back.Stamp == 0)
+		{
+			FMemory::Memzero(Back.CellStamp.GetData(), Back.CellStamp.Num() * sizeof(uint32));
+			Back.Stamp = 1;
+		}
+
+		Back.TargetCell = TargetCell;
+		OpenHeap.Reset();
+
+		auto AddSource = [&](const uint32 Cell, const float Distance)
+		{
+			Back.CellStamp[Cell] = Back.Stamp;
+			Back.Distance[Cell] = Distance;
+			Back.Next[Cell] = LinearOctree::InvalidIndex;
+			OpenHeap.HeapPush({Distance, Cell});
+		};
+
+		//An occupied target (pressed against a wall) is never anyone's neighbor, so the free cells around it head straight for it instead.
+		if (Octree.IsOccupied(TargetCell))
+		{
+			Neighbors.Reset();
+			Octree.GetNeighbors(TargetCell, Neighbors);
+			if (Neighbors.IsEmpty())
+			{
+				if (Debug) UE_LOG(LogTemp, Warning, TEXT("Flow field target is inaccessible."));
+				return false;
+			}
+
+			for (const uint32 Neighbor : Neighbors)
+			{
+				AddSource(Neighbor, FVector::Dist(Octree.GetNodeCenter(Neighbor), Target));
+			}
+		}
+		else
+		{
+			AddSource(TargetCell, 0);
+		}
+
+		Building = true;
+		BuildTime = 0;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	while (!OpenHeap.IsEmpty())
+	{
+		if (ThreadIsPaused)
+		{
+			BuildTime += FPlatformTime::Seconds() - StartTime;
+			return false;
+		}
+
+		FOpenEntry Current;
+		OpenHeap.HeapPop(Current, EAllowShrinking::No);
+
+		//The heap can hold outdated copies of a cell that got closer later on.
+		if (Current.Distance > Back.Distance[Current.Cell]) continue;
+
+		const FVector CurrentCenter = Octree.GetNodeCenter(Current.Cell);
+		Neighbors.Reset();
+		Octree.GetNeighbors(Current.Cell, Neighbors);
+
+		for (const uint32 Neighbor : Neighbors)
+		{
+			const float Distance = Current.Distance + FVector::Dist(CurrentCenter, Octree.GetNodeCenter(Neighbor));
+			if (Back.Contains(Neighbor) && Back.Distance[Neighbor] <= Distance) continue;
+
+			Back.CellStamp[Neighbor] = Back.Stamp;
+			Back.Distance[Neighbor] = Distance;
+			Back.Next[Neighbor] = Current.Cell;
+			OpenHeap.HeapPush({Distance, Neighbor});
+		}
+	}
+
+	{
+		FWriteScopeLock Lock(SwapLock);
+		FrontField = 1 - FrontField;
+	}
+
+	Building = false;
+	BuildTime += FPlatformTime::Seconds() - StartTime;
+	if (Debug) UE_LOG(LogTemp, Warning, TEXT("Flow field toward cell %u built in %f ms."), Back.TargetCell, BuildTime * 1000.0);
+
+	return true;
+}
+
+bool FLinearOctreeFlowField::GetNextLocation(const FVector& From, const FVector& Target, FVector& OutLocation) const
+{
+	FReadScopeLock Lock(SwapLock);
+
+	const FField& Field = Fields[FrontField];
+	if (Field.Stamp == 0) return false;
+
+	//Built for someone else's target, or for where ours was before it moved to another leaf.
+	if (Octree.FindLeaf(Target) != Field.TargetCell) return false;
+
+	const uint32 Cell = Octree.FindLeaf(From);
+	if (Cell == LinearOctree::InvalidIndex || !Field.Contains(Cell)) return false;
+
+	if (Field.Next[Cell] != LinearOctree::InvalidIndex)
+	{
+		OutLocation = Octree.GetNodeCenter(Field.Next[Cell]);
+		return true;
+	}
+
+	//Next to the target. Heading for where it is now rather than where it was when the field was built.
+	OutLocation = Target;
+	return true;
+}
+
+bool FLinearOctreeFlowField::HasField() const
+{
+	FReadScopeLock Lock(SwapLock);
+	return Fields[FrontField].Stamp != 0;
+}
+
+SIZE_T FLinearOctreeFlowField::GetAllocatedSize() const
+{
+	SIZE_T Size = OpenHeap.GetAllocatedSize() + Neighbors.GetAllocatedSize();
+	for (const FField& Field : Fields)
+	{
+		Size += Field.Next.GetAllocatedSize() + Field.Distance.GetAllocatedSize() + Field.CellStamp.GetAllocatedSize();
+	}
+
+	return Size;
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/LinearOctreeHierarchy.h"
+
+FLinearOctreeHierarchy::FLinearOctreeHierarchy(const FLinearOctree& InOctree, const int32 ClusterLevels) : Octree(InOctree)
+{
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	ClusterDepth = FMath::Max(0, Octree.GetMaxDepth() - ClusterLevels);
+
+	//Children always come after their parent in the pool, so one pass in index order can hand the cluster down.
+	NodeClusters.SetNumUninitialized(Octree.NumNodes());
+	for (int32 i = 0; i < Octree.NumNodes(); i++)
+	{
+		const FLinearOctreeNode& Node = Octree.GetNode(i);
+		const int32 Depth = Node.GetDepth();
+
+		if (Depth > ClusterDepth)
+		{
+			NodeClusters[i] = NodeClusters[Octree.GetParent(i)];
+		}
+		else if (Depth == ClusterDepth || Node.IsLeaf())
+		{
+			NodeClusters[i] = ClusterCenters.Add(Octree.GetNodeCenter(i));
+		}
+		else
+		{
+			NodeClusters[i] = LinearOctree::InvalidIndex;
+		}
+	}
+
+	//Every free cell looks at its neighbors, any of them in another cluster is a portal.
+	TArray<uint64> Pairs;
+	TArray<uint32> Neighbors;
+	auto AddPortals = [&](const uint32 Cell)
+	{
+		const uint32 Cluster = GetCluster(Cell);
+
+		Neighbors.Reset();
+		Octree.GetNeighbors(Cell, Neighbors);
+
+		for (const uint32 Neighbor : Neighbors)
+		{
+			const uint32 NeighborCluster = GetCluster(Neighbor);
+			if (NeighborCluster != Cluster)
+			{
+				Pairs.Add((static_cast<uint64>(Cluster) << 32) | NeighborCluster);
+			}
+		}
+	};
+
+	for (int32 i = 0; i < Octree.NumNodes(); i++)
+	{
+		const FLinearOctreeNode& Node = Octree.GetNode(i);
+		if (Node.IsLeaf() && !Node.IsOccupied())
+		{
+			AddPortals(i);
+		}
+	}
+
+	for (int32 i = Octree.NumNodes(); i < Octree.NumCells(); i++)
+	{
+		if (!Octree.IsOccupied(i))
+		{
+			AddPortals(i);
+		}
+	}
+
+	//Neighbors are symmetric, so both directions are already in there. Sorting groups them by cluster, which is the layout of Links.
+	Pairs.Sort();
+	LinkStarts.SetNumZeroed(ClusterCenters.Num() + 1);
+	Links.Reserve(Pairs.Num());
+
+	for (int32 i = 0; i < Pairs.Num(); i++)
+	{
+		if (i > 0 && Pairs[i] == Pairs[i - 1]) continue;
+
+		LinkStarts[(Pairs[i] >> 32) + 1]++;
+		Links.Add(static_cast<uint32>(Pairs[i]));
+	}
+
+	for (int32 i = 1; i < LinkStarts.Num(); i++)
+	{
+		LinkStarts[i] += LinkStarts[i - 1];
+	}
+
+	Links.Shrink();
+}
+
+uint32 FLinearOctreeHierarchy::GetCluster(const uint32 CellIndex) const
+{
+	return NodeClusters[Octree.IsVoxel(CellIndex) ? Octree.GetParent(CellIndex) : CellIndex];
+}
@@ -3,12 +3,18 @@
 #include "ProceduralMeshComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "ActivatableObjects/ActivatableObjectsBase.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "Pathfinding/OctreePathfindingComponent.h"
+#include "Pathfinding/OctreePathfindingSubsystem.h"
 
 
 AOctree::AOctree()
 {
+	//Only ticks to follow the dynamic obstacles, see SetUpOctree().
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
 	// Create the default scene component
 	DefaultSceneComponent = CreateDefaultSubobject<USceneComponent>("DefaultSceneComponent");
 	SetRootComponent(DefaultSceneComponent);
@@ -38,10 +44,35 @@ AOctree::AOctree()
 void AOctree::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
-	if (RootNodeSharedPtr.IsValid())
+	if (NodeArena.IsValid())
 	{
 		//DrawGrid();
 	}
+
+	if (!SearchGraph.IsValid() || !NodeArena.IsValid())
+	{
+		return;
+	}
+
+	for (auto It = DynamicObstacles.CreateIterator(); It; ++It)
+	{
+		const AActor* Actor = It->Key.Get();
+		if (Actor == nullptr)
+		{
+			SearchGraph->RemoveObstacle(It->Value.Id);
+			It.RemoveCurrent();
+			continue;
+		}
+
+		const FBox Bounds = Actor->GetComponentsBoundingBox();
+		if (Bounds.Min.Equals(It->Value.Bounds.Min, DynamicObstacleTolerance) && Bounds.Max.Equals(It->Value.Bounds.Max, DynamicObstacleTolerance)) continue;
+
+		It->Value.Bounds = Bounds;
+		SearchGraph->MoveObstacle(It->Value.Id, Bounds);
+	}
+
+	//Otherwise the searches apply them, see FOctreeSearchGraph::MaxObstacleDelay.
+	SearchGraph->TryApplyObstacleUpdates();
 }
 
 void AOctree::BeginPlay()
@@ -63,14 +94,112 @@ void AOctree::EndPlay(const EEndPlayReason::Type EndPlayReason)
 	Loading = false;
 
 	// Clean up
-	if (PathfindingWorker.IsValid())
+	//Searches already running hold on to the graph until they stop, which they do right away once cancelled.
+	if (SearchGraph.IsValid())
 	{
-		PathfindingWorker->Stop();
-		PathfindingWorker->Exit();
-		PathfindingWorker.Reset();
+		if (const UOctreePathfindingSubsystem* Pathfinding = GetWorld()->GetSubsystem<UOctreePathfindingSubsystem>())
+		{
+			Pathfinding->GetService().CancelAll(SearchGraph.Get());
+		}
+		SearchGraph.Reset();
+	}
+
+	if (FlowFieldWorker.IsValid())
+	{
+		FlowFieldWorker->Stop();
+		FlowFieldWorker->Exit();
+		FlowFieldWorker.Reset();
 	}
 
-	OctreeNode::DeleteOctreeNode(RootNodeSharedPtr);
+	//The whole tree goes with the arena.
+	DynamicObstacles.Reset();
+	NodeArena.Reset();
+	FlowField.Reset();
+	LinearHierarchy.Reset();
+	LinearOctree.Reset();
+}
+
+void AOctree::RegisterSearchGraph(const TSharedPtr<FOctreeSearchGraph>& Graph)
+{
+	Graph->PathSettings = GetPathSettings();
+	Graph->Debug = Debug;
+	Graph->MaxAgentStates = MaxAgentSearchTrees;
+	Graph->MaxObstacleDelay = ObstacleUpdateMaxDelay;
+	SearchGraph = Graph;
+
+	if (UOctreePathfindingSubsystem* Pathfinding = GetWorld()->GetSubsystem<UOctreePathfindingSubsystem>())
+	{
+		Pathfinding->GetService().SetWorkerCount(PathfindingWorkerCount);
+	}
+}
+
+bool AOctree::Raycast(const FVector& From, const FVector& To, const float Radius, FOctreeRaycastHit& OutHit) const
+{
+	if (!SearchGraph.IsValid())
+	{
+		OutHit = FOctreeRaycastHit();
+		return false;
+	}
+
+	return SearchGraph->Raycast(From, To, Radius, OutHit);
+}
+
+bool AOctree::HasLineOfSight(const FVector& From, const FVector& To, const float Radius) const
+{
+	if (!SearchGraph.IsValid())
+	{
+		return true;
+	}
+
+	return SearchGraph->HasLineOfSight(From, To, Radius);
+}
+
+int32 AOctree::AddObstacle(const FBox& Box)
+{
+	if (!SearchGraph.IsValid() || !NodeArena.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Dynamic obstacles need the pointer backend to be set up. The obstacle is ignored."));
+		return INDEX_NONE;
+	}
+
+	return SearchGraph->AddObstacle(Box);
+}
+
+void AOctree::MoveObstacle(const int32 Id, const FBox& Box)
+{
+	if (SearchGraph.IsValid() && NodeArena.IsValid() && Id != INDEX_NONE)
+	{
+		SearchGraph->MoveObstacle(Id, Box);
+	}
+}
+
+void AOctree::RemoveObstacle(const int32 Id)
+{
+	if (SearchGraph.IsValid() && NodeArena.IsValid() && Id != INDEX_NONE)
+	{
+		SearchGraph->RemoveObstacle(Id);
+	}
+}
+
+void AOctree::FindNearestFreeLeaves(const FVector& Location, const float MaxRadius, const int32 Count, TArray<FBox>& OutLeaves) const
+{
+	if (SearchGraph.IsValid())
+	{
+		SearchGraph->FindNearestFreeLeaves(Location, MaxRadius, Count, OutLeaves);
+	}
+}
+
+bool AOctree::SnapToFreeSpace(const FVector& Location, const float MaxRadius, FVector& OutLocation) const
+{
+	TArray<FBox> Nearest;
+	FindNearestFreeLeaves(Location, MaxRadius, 1, Nearest);
+	if (Nearest.IsEmpty())
+	{
+		return false;
+	}
+
+	OutLocation = OctreeGraph::SnapIntoLeaf(Nearest[0], Location);
+	return true;
 }
 
 void AOctree::OnConstruction(const FTransform& Transform)
@@ -144,53 +273,31 @@ void AOctree::DrawGrid()
 	TArray<FVector> Vertices;
 	TArray<int32> Triangles;
 
-	TArray<TSharedPtr<OctreeNode>> NodeList;
-	NodeList.Add(RootNodeSharedPtr);
+	if (LinearOctree.IsValid())
+	{
+		for (int32 i = 0; i < LinearOctree->NumCells(); i++)
+		{
+			const bool IsLeaf = LinearOctree->IsVoxel(i) || LinearOctree->GetNode(i).IsLeaf();
+			if (IsLeaf && !LinearOctree->IsOccupied(i))
+			{
+				DrawNodeBorders(LinearOctree->GetNodeCenter(i), FVector(LinearOctree->GetNodeHalfSize(i)), Vertices, Triangles);
+			}
+		}
+	}
+
+	TArray<const OctreeNode*> NodeList;
+	if (NodeArena.IsValid()) NodeList.Add(NodeArena->GetRoot());
 
 
 	for (int i = 0; i < NodeList.Num(); i++)
 	{
-		if (!NodeList[i].IsValid()) continue;
-
-		for (const auto& Child : NodeList[i]->ChildrenOctreeNodes)
+		for (const OctreeNode& Child : NodeList[i]->GetChildren())
 		{
-			if (Child.IsValid())
+			if (!Child.Occupied && !Child.HasChildren())
 			{
-				if (!Child->Occupied && Child->ChildrenOctreeNodes.Num() == 0)
-				{
-					const FVector Center = Child->Position;
-					const FVector Extent = FVector(Child->HalfSize);
-
-					// Draw lines for each edge of the cube
-					DrawLine(Center - Extent, FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z), FVector::RightVector, Vertices,
-					         Triangles);
-					DrawLine(FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z),
-					         FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z), FVector::ForwardVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z),
-					         FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z), FVector::RightVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z),
-					         FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z), FVector::ForwardVector, Vertices, Triangles);
-
-					DrawLine(FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z),
-					         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::RightVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z),
-					         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z), FVector::ForwardVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z),
-					         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z), FVector::RightVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z),
-					         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::ForwardVector, Vertices, Triangles);
-
-					DrawLine(FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z),
-					         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::UpVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z),
-					         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z), FVector::UpVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z),
-					         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::UpVector, Vertices, Triangles);
-					DrawLine(FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z),
-					         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::UpVector, Vertices, Triangles);
-				}
-				NodeList.Add(Child);
+				DrawNodeBorders(Child.Position, FVector(Child.HalfSize), Vertices, Triangles);
 			}
+			NodeList.Add(&Child);
 		}
 	}
 
@@ -214,6 +321,37 @@ void AOctree::DrawGrid()
 	ProceduralMesh->SetMaterial(0, DynamicMaterialInstance);
 }
 
+void AOctree::DrawNodeBorders(const FVector& Center, const FVector& Extent, TArray<FVector>& Vertices, TArray<int32>& Triangles) const
+{
+	// Draw lines for each edge of the cube
+	DrawLine(Center - Extent, FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z), FVector::RightVector, Vertices,
+	         Triangles);
+	DrawLine(FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z),
+	         FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z), FVector::ForwardVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z),
+	         FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z), FVector::RightVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z),
+	         FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z), FVector::ForwardVector, Vertices, Triangles);
+
+	DrawLine(FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z),
+	         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::RightVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z),
+	         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z), FVector::ForwardVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z),
+	         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z), FVector::RightVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z),
+	         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::ForwardVector, Vertices, Triangles);
+
+	DrawLine(FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z),
+	         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::UpVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X - Extent.X, Center.Y - Extent.Y, Center.Z + Extent.Z),
+	         FVector(Center.X - Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z), FVector::UpVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X + Extent.X, Center.Y - Extent.Y, Center.Z - Extent.Z),
+	         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::UpVector, Vertices, Triangles);
+	DrawLine(FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z + Extent.Z),
+	         FVector(Center.X + Extent.X, Center.Y + Extent.Y, Center.Z - Extent.Z), FVector::UpVector, Vertices, Triangles);
+}
+
 void AOctree::DeleteGrid()
 {
 	GridDrawn = false;
@@ -366,14 +504,132 @@ void AOctree::ResizeOctree()
 }
 
 void AOctree::SetUpOctree()
+{
+	if (Backend == EOctreeBackend::Linear)
+	{
+		LinearOctree = MakeShareable(new FLinearOctree(GetVolumeBounds(), MinNodeSize));
+
+		if (!LoadBakedOctree())
+		{
+			TArray<FBox> BoxResults;
+			CollectActorBoxes(BoxResults);
+			LinearOctree->Build(FOctreeBoxIndex(BoxResults));
+		}
+
+		if (LabelFreeSpaceComponents)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			LinearOctree->LabelComponents();
+
+			if (Debug)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Octree free space: %i components, labelled in %f ms."), LinearOctree->NumComponents(),
+				       (FPlatformTime::Seconds() - StartTime) * 1000.0);
+			}
+		}
+
+		if (UseHierarchicalSearch)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			LinearHierarchy = MakeShareable(new FLinearOctreeHierarchy(*LinearOctree, HierarchyClusterLevels));
+
+			if (Debug)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Octree hierarchy: %i clusters, %i portal links, %llu KB, built in %f ms."), LinearHierarchy->NumClusters(),
+				       LinearHierarchy->NumLinks(), static_cast<uint64>(LinearHierarchy->GetAllocatedSize() / 1024), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+			}
+		}
+
+		if (UseFlowField)
+		{
+			FlowField = MakeShareable(new FLinearOctreeFlowField(*LinearOctree));
+			FlowFieldWorker = MakeShareable(new FPathfindingWorker(LinearOctree, FlowField, Debug));
+		}
+
+		const TSharedPtr<FOctreeSearchGraph> Graph = MakeShared<FOctreeSearchGraph>();
+		Graph->LinearOctree = LinearOctree;
+		Graph->LinearHierarchy = LinearHierarchy;
+		RegisterSearchGraph(Graph);
+		return;
+	}
+
+	TArray<FBox> BoxResults;
+	TArray<AActor*> DynamicActors;
+	CollectActorBoxes(BoxResults, &DynamicActors);
+
+	//The workers share the arena, the searches take its locks.
+	NodeArena = MakeNodeArena();
+
+	const TSharedPtr<FOctreeSearchGraph> Graph = MakeShared<FOctreeSearchGraph>();
+	Graph->NodeArena = NodeArena;
+	Graph->ActorBoxes.Build(BoxResults);
+	Graph->MinSize = MinNodeSize;
+	RegisterSearchGraph(Graph);
+
+	for (AActor* Actor : DynamicActors)
+	{
+		const FBox Bounds = Actor->GetComponentsBoundingBox();
+		DynamicObstacles.Add(Actor, {Graph->AddObstacle(Bounds), Bounds});
+	}
+
+	//Nothing searches the graph yet, so they are in before the first search. The tick follows them from there.
+	Graph->TryApplyObstacleUpdates();
+	SetActorTickEnabled(true);
+}
+
+FOctreePathSettings AOctree::GetPathSettings() const
+{
+	FOctreePathSettings Settings;
+	Settings.AnyAngle = UseAnyAnglePaths;
+	Settings.AgentRadius = AgentRadius;
+	Settings.Funnel = UseFunnelPaths;
+	Settings.SnapRadius = SnapRadius;
+	Settings.Incremental = UseIncrementalSearch;
+	Settings.TimeBudget = SearchTimeBudget;
+	Settings.ExpansionBudget = SearchExpansionBudget;
+	Settings.HeuristicWeight = HeuristicWeight;
+	Settings.Anytime = UseAnytimeSearch;
+	Settings.FinalHeuristicWeight = FinalHeuristicWeight;
+	Settings.HeuristicWeightStep = HeuristicWeightStep;
+	return Settings;
+}
+
+TSharedPtr<FOctreeNodeArena> AOctree::MakeNodeArena() const
 {
 	float MaxSize = FMath::Max3(ExpandVolumeXAxis, ExpandVolumeYAxis, ExpandVolumeZAxis) * SingleVolumeSize;
 	//Add a little bit of padding, in case there is one single Octree underneath, which sometimes prevent FindNode to work properly.
 	MaxSize *= 1.02f;
 
-	RootNodeSharedPtr = MakeShareable(new OctreeNode(GetActorLocation(), MaxSize / 2));
-	RootNodeSharedPtr->Occupied = true;
+	TSharedPtr<FOctreeNodeArena> Arena = MakeShareable(new FOctreeNodeArena(GetActorLocation(), MaxSize / 2));
+	Arena->MemoryBudget = static_cast<SIZE_T>(NodeMemoryBudget * 1024 * 1024);
+	Arena->EvictionTimeBudget = EvictionTimeBudget / 1000.0;
+	OctreeNode* RootNode = Arena->GetRoot();
+	RootNode->Occupied = true;
+
+	if (!AutoEncapsulateObjects)
+	{
+		int Index = 0;
+		const TArrayView<OctreeNode> ExpandVolumes = Arena->DivideCustom(*RootNode, ExpandVolumeXAxis * ExpandVolumeYAxis * ExpandVolumeZAxis);
 
+		for (int X = 0; X < ExpandVolumeXAxis; X++)
+		{
+			for (int Y = 0; Y < ExpandVolumeYAxis; Y++)
+			{
+				for (int Z = 0; Z < ExpandVolumeZAxis; Z++)
+				{
+					const FVector Offset = FVector(X * SingleVolumeSize, Y * SingleVolumeSize, Z * SingleVolumeSize);
+					ExpandVolumes[Index] = OctreeNode(GetActorLocation() + Offset, SingleVolumeSize / 2);
+					Index++;
+				}
+			}
+		}
+	}
+
+	return Arena;
+}
+
+void AOctree::CollectActorBoxes(TArray<FBox>& OutBoxes, TArray<AActor*>* OutDynamicActors) const
+{
 	TArray<FOverlapResult> Result;
 	FCollisionQueryParams TraceParams;
 	TraceParams.AddIgnoredActor(this);
@@ -386,13 +642,8 @@ void AOctree::SetUpOctree()
 		}
 	}
 
-	TArray<FBox> BoxResults;
-
 	if (!AutoEncapsulateObjects)
 	{
-		int Index = 0;
-		RootNodeSharedPtr->ChildrenOctreeNodes.SetNum(ExpandVolumeXAxis * ExpandVolumeYAxis * ExpandVolumeZAxis);
-
 		for (int X = 0; X < ExpandVolumeXAxis; X++)
 		{
 			for (int Y = 0; Y < ExpandVolumeYAxis; Y++)
@@ -401,20 +652,17 @@ void AOctree::SetUpOctree()
 				{
 					TArray<FOverlapResult> ChildOverlaps;
 					const FVector Offset = FVector(X * SingleVolumeSize, Y * SingleVolumeSize, Z * SingleVolumeSize);
-					RootNodeSharedPtr->ChildrenOctreeNodes[Index] = MakeShareable(new OctreeNode(GetActorLocation() + Offset, SingleVolumeSize / 2));
 					GetWorld()->OverlapMultiByChannel
 					(
 						ChildOverlaps,
-						RootNodeSharedPtr->ChildrenOctreeNodes[Index]->Position,
+						GetActorLocation() + Offset,
 						FQuat::Identity,
 						CollisionChannel,
 						FCollisionShape::MakeBox(FVector(SingleVolumeSize / 2)),
 						TraceParams
 					);
-					Index++;
 
-					//TODO make arrays of arrays instead of one big, then modify findandlode that looks at child rootnode specifically, saving time
-					//in the begininng it scopes down to a single child root node so we know the index of which box array we would look at.
+					//One big array is fine, FOctreeBoxIndex sorts the boxes into cells so a node only looks at the ones around it.
 					Result.Append(ChildOverlaps);
 				}
 			}
@@ -425,7 +673,7 @@ void AOctree::SetUpOctree()
 		GetWorld()->OverlapMultiByChannel
 		(
 			Result,
-			RootNodeSharedPtr->Position,
+			GetActorLocation(),
 			FQuat::Identity, CollisionChannel,
 			FCollisionShape::MakeBox(FVector(SingleVolumeSize / 2)),
 			TraceParams
@@ -437,8 +685,109 @@ void AOctree::SetUpOctree()
 	{
 		if (Overlap.GetActor()->ActorHasTag(OctreeIgnoreTag)) continue;
 
-		BoxResults.Add(Overlap.GetActor()->GetComponentsBoundingBox());
+		if (OutDynamicActors != nullptr && IsDynamicObstacle(Overlap.GetActor()))
+		{
+			//Overlapping several expand volumes finds it more than once.
+			OutDynamicActors->AddUnique(Overlap.GetActor());
+			continue;
+		}
+
+		OutBoxes.Add(Overlap.GetActor()->GetComponentsBoundingBox());
 	}
+}
 
-	PathfindingWorker = MakeShareable(new FPathfindingWorker(RootNodeSharedPtr, Debug, BoxResults, MinNodeSize));
+bool AOctree::IsDynamicObstacle(const AActor* Actor) const
+{
+	return Actor->ActorHasTag(OctreeDynamicTag) || Actor->FindComponentByClass<UActivatableObjectsBase>() != nullptr;
+}
+
+FBox AOctree::GetVolumeBounds() const
+{
+	//The expand volumes are laid out from the actor location towards the positive axes, the first one being centered on the actor.
+	const FVector HalfVolume = FVector(SingleVolumeSize / 2.0f);
+	const FVector VolumeCount = FVector(ExpandVolumeXAxis, ExpandVolumeYAxis, ExpandVolumeZAxis);
+
+	return FBox(GetActorLocation() - HalfVolume, GetActorLocation() - HalfVolume + VolumeCount * SingleVolumeSize);
+}
+
+#pragma endregion
+
+#pragma region Baking
+
+FString AOctree::GetBakeFilePath(const uint64 GeometryHash)
+{
+	//Staged as loose files (see DefaultGame.ini), so they can be memory mapped in packaged builds too.
+	return FPaths::ProjectContentDir() / TEXT("OctreeBakes") / FString::Printf(TEXT("%016llx.octree"), GeometryHash);
+}
+
+void AOctree::BakeOctree()
+{
+	TArray<FBox> BoxResults;
+	CollectActorBoxes(BoxResults);
+
+	const FBox VolumeBounds = GetVolumeBounds();
+	const uint64 GeometryHash = FLinearOctree::HashGeometry(VolumeBounds, MinNodeSize, BoxResults);
+	const FString FilePath = GetBakeFilePath(GeometryHash);
+
+	Modify();
+	BakedGeometryHash = GeometryHash;
+
+	if (Backend != EOctreeBackend::Linear)
+	{
+		//The pointer backend would have to allocate every node again, which is exactly what baking avoids.
+		UE_LOG(LogTemp, Warning, TEXT("Baked octrees are used through the linear backend. Switching %s to it."), *GetName());
+		Backend = EOctreeBackend::Linear;
+	}
+
+	FLinearOctree BakedOctree(VolumeBounds, MinNodeSize);
+
+	if (BakedOctree.LoadBake(FilePath, GeometryHash))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Octree geometry did not change, reusing bake %s."), *FilePath);
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	BakedOctree.Build(FOctreeBoxIndex(BoxResults));
+
+	if (!BakedOctree.SaveBake(FilePath, GeometryHash))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not write octree bake %s."), *FilePath);
+		return;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Baked %i octree nodes and %i bricks (%llu KB) in %f seconds to %s."), BakedOctree.NumNodes(), BakedOctree.NumBricks(),
+	       static_cast<uint64>(BakedOctree.GetAllocatedSize() / 1024), FPlatformTime::Seconds() - StartTime, *FilePath);
+}
+
+bool AOctree::LoadBakedOctree()
+{
+	if (!UseBakedOctree || BakedGeometryHash == 0)
+	{
+		return false;
+	}
+
+	const FString FilePath = GetBakeFilePath(BakedGeometryHash);
+
+	if (!LinearOctree->LoadBake(FilePath, BakedGeometryHash))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Octree bake %s is missing or does not match the octree settings. Building the octree instead."), *FilePath);
+		return false;
+	}
+
+#if WITH_EDITOR
+	//The level might have been edited since the last bake. Checking it costs the overlaps the bake is meant to skip, so only in the editor.
+	TArray<FBox> BoxResults;
+	CollectActorBoxes(BoxResults);
+
+	if (FLinearOctree::HashGeometry(GetVolumeBounds(), MinNodeSize, BoxResults) != BakedGeometryHash)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Octree bake %s is outdated, the level changed since it was baked. Building the octree instead."), *FilePath);
+		return false;
+	}
+#endif
+
+	return true;
 }
+
+#pragma endregion
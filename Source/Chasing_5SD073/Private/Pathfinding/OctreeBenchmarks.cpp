@@ -0,0 +1,498 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/Octree.h"
+#include "Async/Async.h"
+
+void AOctree::MakeBenchmarkFixture(FBenchmarkFixture& OutFixture, const bool BuildLinear) const
+{
+	TArray<FBox> BoxResults;
+	CollectActorBoxes(BoxResults);
+	OutFixture.Boxes.Build(BoxResults);
+
+	OutFixture.VolumeBounds = GetVolumeBounds();
+	OutFixture.Linear = MakeUnique<FLinearOctree>(OutFixture.VolumeBounds, MinNodeSize);
+	if (BuildLinear)
+	{
+		OutFixture.Linear->Build(OutFixture.Boxes);
+	}
+}
+
+void AOctree::BenchmarkBackends()
+{
+	FBenchmarkFixture Fixture;
+	MakeBenchmarkFixture(Fixture, false);
+	const FOctreeBoxIndex& Boxes = Fixture.Boxes;
+	const std::atomic<bool>& ThreadIsPaused = Fixture.ThreadIsPaused;
+
+	TArray<FVector> Queries;
+	Queries.SetNumUninitialized(BenchmarkQueryCount);
+	for (FVector& Query : Queries)
+	{
+		Query = Fixture.Random.RandPointInBox(Fixture.VolumeBounds);
+	}
+
+	//Counting the found nodes so the compiler cannot throw the loops away.
+	int32 Found = 0;
+
+	//Pointer backend. The first pass also divides the tree, the second one only descends.
+	TSharedPtr<FOctreeNodeArena> PointerArena = MakeNodeArena();
+	OctreeNode* PointerRoot = PointerArena->GetRoot();
+
+	double Begin = FPlatformTime::Seconds();
+	for (const FVector& Query : Queries)
+	{
+		Found += PointerRoot->LazyDivideAndFindNode(ThreadIsPaused, *PointerArena, Boxes, MinNodeSize, Query, false) != nullptr;
+	}
+	const double PointerColdTime = FPlatformTime::Seconds() - Begin;
+
+	Begin = FPlatformTime::Seconds();
+	for (const FVector& Query : Queries)
+	{
+		Found += PointerRoot->LazyDivideAndFindNode(ThreadIsPaused, *PointerArena, Boxes, MinNodeSize, Query, false) != nullptr;
+	}
+	const double PointerWarmTime = FPlatformTime::Seconds() - Begin;
+
+	//The arena reserves whole slabs, so this is a bit more than the nodes alone.
+	const int32 PointerNodeCount = PointerArena->NumNodes();
+	const SIZE_T PointerBytes = PointerArena->GetAllocatedSize();
+	PointerArena.Reset();
+
+	//The nearest free leaves on a fresh tree, where the root's children are not divided yet. None of them may touch a level box.
+	TSharedPtr<FOctreeNodeArena> FreshArena = MakeNodeArena();
+	TArray<OctreeNode*> FreeLeaves;
+	const int32 FreeLeafQueryCount = FMath::Min(Queries.Num(), 1000);
+	int32 OccupiedFreeLeaves = 0;
+	for (int32 i = 0; i < FreeLeafQueryCount; i++)
+	{
+		FreeLeaves.Reset();
+		OctreeGraph::FindNearestFreeLeaves(ThreadIsPaused, *FreshArena, Boxes, MinNodeSize, Queries[i], Fixture.VolumeBounds.GetSize().GetMax(), 4, FreeLeaves);
+		for (const OctreeNode* Leaf : FreeLeaves)
+		{
+			OccupiedFreeLeaves += Boxes.Classify(FBox::BuildAABB(Leaf->Position, FVector(Leaf->HalfSize))) != FOctreeBoxIndex::EOverlap::None;
+		}
+	}
+	FreshArena.Reset();
+
+	if (OccupiedFreeLeaves > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Nearest free leaves: %i of the leaves returned over %i queries overlap a level box."), OccupiedFreeLeaves, FreeLeafQueryCount);
+	}
+
+	//Linear backend. Everything is divided up front, so there is only one kind of pass.
+	FLinearOctree& Linear = *Fixture.Linear;
+
+	Begin = FPlatformTime::Seconds();
+	Linear.Build(Boxes);
+	const double LinearBuildTime = FPlatformTime::Seconds() - Begin;
+
+	Begin = FPlatformTime::Seconds();
+	for (const FVector& Query : Queries)
+	{
+		Found += Linear.FindLeaf(Query) != LinearOctree::InvalidIndex;
+	}
+	const double LinearTime = FPlatformTime::Seconds() - Begin;
+
+	const double ToMicroPerQuery = 1000000.0 / Queries.Num();
+
+	UE_LOG(LogTemp, Warning, TEXT("Octree backend benchmark, %i boxes, %i queries (%i found). %i nearest free leaf queries, %i leaves overlapping a box."),
+	       Boxes.Num(), Queries.Num(), Found, FreeLeafQueryCount, OccupiedFreeLeaves);
+	UE_LOG(LogTemp, Warning, TEXT("Pointer: %i nodes, ~%llu bytes per node, ~%llu KB. Descent %f us (first pass, dividing), %f us (second pass)."),
+	       PointerNodeCount, static_cast<uint64>(PointerBytes / FMath::Max(PointerNodeCount, 1)), static_cast<uint64>(PointerBytes / 1024),
+	       PointerColdTime * ToMicroPerQuery, PointerWarmTime * ToMicroPerQuery);
+	UE_LOG(LogTemp, Warning, TEXT("Linear: %i nodes and %i bricks, %llu KB. Build %f ms. Descent %f us."),
+	       Linear.NumNodes(), Linear.NumBricks(), static_cast<uint64>(Linear.GetAllocatedSize() / 1024), LinearBuildTime * 1000.0,
+	       LinearTime * ToMicroPerQuery);
+}
+
+void AOctree::BenchmarkBoxIndex()
+{
+	const FBox VolumeBounds = GetVolumeBounds();
+	FRandomStream Random(1234);
+
+	//Node boxes of the sizes the octree actually asks about, from the min size up to 1/16 of the volume.
+	TArray<FBox> NodeBoxes;
+	NodeBoxes.SetNumUninitialized(10000);
+	const int32 MaxLevel = FMath::Max(0, FMath::FloorLog2(FMath::Max(1, FMath::FloorToInt32(VolumeBounds.GetSize().GetMax() / MinNodeSize))) - 4);
+	for (FBox& NodeBox : NodeBoxes)
+	{
+		const double HalfSize = MinNodeSize * (1 << Random.RandRange(0, MaxLevel)) / 2;
+		NodeBox = FBox::BuildAABB(Random.RandPointInBox(VolumeBounds), FVector(HalfSize));
+	}
+
+	const double ToMicroPerQuery = 1000000.0 / NodeBoxes.Num();
+
+	for (const int32 BoxCount : {1000, 10000, 100000})
+	{
+		TArray<FBox> Boxes;
+		Boxes.SetNumUninitialized(BoxCount);
+		for (FBox& Box : Boxes)
+		{
+			const FVector Extent(Random.FRandRange(0.5f, 8) * MinNodeSize, Random.FRandRange(0.5f, 8) * MinNodeSize, Random.FRandRange(0.5f, 8) * MinNodeSize);
+			Box = FBox::BuildAABB(Random.RandPointInBox(VolumeBounds), Extent / 2);
+		}
+
+		double Begin = FPlatformTime::Seconds();
+		const FOctreeBoxIndex Index(Boxes);
+		const double BuildTime = FPlatformTime::Seconds() - Begin;
+
+		//The two loops LazyDivideAndFindNode used to run.
+		TArray<FOctreeBoxIndex::EOverlap> Expected;
+		Expected.SetNumUninitialized(NodeBoxes.Num());
+		Begin = FPlatformTime::Seconds();
+		for (int32 i = 0; i < NodeBoxes.Num(); i++)
+		{
+			Expected[i] = FOctreeBoxIndex::EOverlap::None;
+			for (const FBox& Box : Boxes)
+			{
+				if (NodeBoxes[i].Intersect(Box))
+				{
+					Expected[i] = FOctreeBoxIndex::EOverlap::Intersects;
+					break;
+				}
+			}
+
+			if (Expected[i] == FOctreeBoxIndex::EOverlap::None) continue;
+
+			for (const FBox& Box : Boxes)
+			{
+				if (Box.IsInside(NodeBoxes[i]))
+				{
+					Expected[i] = FOctreeBoxIndex::EOverlap::Inside;
+					break;
+				}
+			}
+		}
+		const double BruteForceTime = FPlatformTime::Seconds() - Begin;
+
+		int32 Mismatches = 0;
+		Begin = FPlatformTime::Seconds();
+		for (int32 i = 0; i < NodeBoxes.Num(); i++)
+		{
+			Mismatches += Index.Classify(NodeBoxes[i]) != Expected[i];
+		}
+		const double IndexTime = FPlatformTime::Seconds() - Begin;
+
+		UE_LOG(LogTemp, Warning, TEXT("Box index, %i boxes: build %f ms, %llu KB. Brute force %f us, index %f us per query. %i mismatches."),
+		       BoxCount, BuildTime * 1000.0, static_cast<uint64>(Index.GetAllocatedSize() / 1024), BruteForceTime * ToMicroPerQuery,
+		       IndexTime * ToMicroPerQuery, Mismatches);
+	}
+}
+
+void AOctree::BenchmarkConcurrentSearches()
+{
+	FBenchmarkFixture Fixture;
+	MakeBenchmarkFixture(Fixture);
+	const FOctreeBoxIndex& Boxes = Fixture.Boxes;
+	const FLinearOctree& Linear = *Fixture.Linear;
+	const std::atomic<bool>& ThreadIsPaused = Fixture.ThreadIsPaused;
+	const bool& NoDebug = Fixture.NoDebug;
+
+	TArray<TPair<FVector, FVector>> Paths;
+	Paths.SetNumUninitialized(BenchmarkPathCount);
+	for (TPair<FVector, FVector>& Path : Paths)
+	{
+		Path = TPair<FVector, FVector>(Fixture.Random.RandPointInBox(Fixture.VolumeBounds), Fixture.Random.RandPointInBox(Fixture.VolumeBounds));
+	}
+
+	TSharedPtr<FOctreeNodeArena> PointerArena = MakeNodeArena();
+
+	constexpr int32 MaxThreads = 16;
+
+	//One context per thread, made up front so growing them is not timed.
+	TArray<FLazyOctreeSearchContext> LazyContexts;
+	TArray<FLinearOctreeSearchScratch> LinearScratches;
+	LazyContexts.SetNum(MaxThreads);
+	LinearScratches.SetNum(MaxThreads);
+
+	//Every thread takes the next path until none are left. Returns the wall time, thread start up included.
+	auto RunPaths = [&](const EOctreeBackend PathBackend, const int32 ThreadCount, int32& OutFound)
+	{
+		std::atomic<int32> NextPath = 0;
+		std::atomic<int32> Found = 0;
+
+		TArray<TFuture<void>> Threads;
+		const double Begin = FPlatformTime::Seconds();
+		for (int32 ThreadIndex = 0; ThreadIndex < ThreadCount; ThreadIndex++)
+		{
+			Threads.Add(Async(EAsyncExecution::Thread, [&, ThreadIndex]()
+			{
+				TArray<FVector> PathPoints;
+				for (int32 Path = NextPath++; Path < Paths.Num(); Path = NextPath++)
+				{
+					PathPoints.Reset();
+					const bool PathFound = PathBackend == EOctreeBackend::Linear
+						                       ? OctreeGraph::LinearOctreeAStar(ThreadIsPaused, NoDebug, Linear, LinearScratches[ThreadIndex],
+						                                                        Paths[Path].Key, Paths[Path].Value, PathPoints)
+						                       : OctreeGraph::LazyOctreeAStar(ThreadIsPaused, NoDebug, Boxes, MinNodeSize, Paths[Path].Key,
+						                                                      Paths[Path].Value, *PointerArena, LazyContexts[ThreadIndex], PathPoints);
+					Found += PathFound;
+				}
+			}));
+		}
+
+		for (TFuture<void>& Thread : Threads)
+		{
+			Thread.Wait();
+		}
+
+		OutFound = Found;
+		return FPlatformTime::Seconds() - Begin;
+	};
+
+	UE_LOG(LogTemp, Warning, TEXT("Concurrent search benchmark, %i boxes, %i paths."), Boxes.Num(), Paths.Num());
+
+	for (const EOctreeBackend PathBackend : {EOctreeBackend::Pointer, EOctreeBackend::Linear})
+	{
+		const TCHAR* BackendName = PathBackend == EOctreeBackend::Linear ? TEXT("Linear") : TEXT("Pointer");
+
+		//Warms every context, and divides the pointer tree along the paths, so the timed runs mostly search.
+		int32 Found = 0;
+		RunPaths(PathBackend, MaxThreads, Found);
+
+		double SingleThreadTime = 0;
+		for (int32 ThreadCount = 1; ThreadCount <= MaxThreads; ThreadCount *= 2)
+		{
+			const double Time = RunPaths(PathBackend, ThreadCount, Found);
+			if (ThreadCount == 1)
+			{
+				SingleThreadTime = Time;
+			}
+
+			UE_LOG(LogTemp, Warning, TEXT("%s, %i threads: %f ms, %f paths per second, %fx of 1 thread. %i found."), BackendName, ThreadCount,
+			       Time * 1000.0, Paths.Num() / Time, SingleThreadTime / Time, Found);
+		}
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Pointer arena after the runs: %i nodes, %llu KB."), PointerArena->NumNodes(),
+	       static_cast<uint64>(PointerArena->GetAllocatedSize() / 1024));
+}
+
+void AOctree::BenchmarkHierarchicalSearch()
+{
+	FBenchmarkFixture Fixture;
+	MakeBenchmarkFixture(Fixture);
+	const FLinearOctree& Linear = *Fixture.Linear;
+	const std::atomic<bool>& ThreadIsPaused = Fixture.ThreadIsPaused;
+	const bool& NoDebug = Fixture.NoDebug;
+
+	double Begin = FPlatformTime::Seconds();
+	const FLinearOctreeHierarchy Hierarchy(Linear, HierarchyClusterLevels);
+	const double HierarchyBuildTime = FPlatformTime::Seconds() - Begin;
+
+	//Only long chases, the short ones are searched the same way in both modes.
+	const double MinDistance = Fixture.VolumeBounds.GetSize().GetMax() / 2;
+	TArray<TPair<FVector, FVector>> Paths;
+	while (Paths.Num() < BenchmarkPathCount)
+	{
+		const FVector Start = Fixture.Random.RandPointInBox(Fixture.VolumeBounds);
+		const FVector End = Fixture.Random.RandPointInBox(Fixture.VolumeBounds);
+		if (FVector::Dist(Start, End) >= MinDistance)
+		{
+			Paths.Add(TPair<FVector, FVector>(Start, End));
+		}
+	}
+
+	FLinearOctreeSearchScratch Scratch;
+	TArray<FVector> PathPoints;
+
+	for (const bool Hierarchical : {false, true})
+	{
+		//Warms the scratch.
+		OctreeGraph::LinearOctreeAStar(ThreadIsPaused, NoDebug, Linear, Scratch, Paths[0].Key, Paths[0].Value, PathPoints);
+
+		int32 Found = 0;
+		int32 PointCount = 0;
+		double WorstTime = 0;
+		const double RunBegin = FPlatformTime::Seconds();
+
+		for (const TPair<FVector, FVector>& Path : Paths)
+		{
+			PathPoints.Reset();
+			Begin = FPlatformTime::Seconds();
+
+			const bool PathFound = Hierarchical
+				                       ? OctreeGraph::HierarchicalLinearOctreeAStar(ThreadIsPaused, NoDebug, Hierarchy, Scratch, Path.Key, Path.Value, PathPoints)
+				                       : OctreeGraph::LinearOctreeAStar(ThreadIsPaused, NoDebug, Linear, Scratch, Path.Key, Path.Value, PathPoints);
+
+			WorstTime = FMath::Max(WorstTime, FPlatformTime::Seconds() - Begin);
+			Found += PathFound;
+			PointCount += PathPoints.Num();
+		}
+
+		const double Time = FPlatformTime::Seconds() - RunBegin;
+
+		UE_LOG(LogTemp, Warning, TEXT("%s search, %i long paths: %f ms avg., %f ms worst. %i found, %f points per path."),
+		       Hierarchical ? TEXT("Hierarchical") : TEXT("Flat"), Paths.Num(), Time * 1000.0 / Paths.Num(), WorstTime * 1000.0, Found,
+		       static_cast<float>(PointCount) / FMath::Max(Found, 1));
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Hierarchy: %i clusters at depth %i (octree depth %i), %i portal links, %llu KB, built in %f ms."),
+	       Hierarchy.NumClusters(), Hierarchy.GetClusterDepth(), Linear.GetMaxDepth(), Hierarchy.NumLinks(),
+	       static_cast<uint64>(Hierarchy.GetAllocatedSize() / 1024), HierarchyBuildTime * 1000.0);
+}
+
+void AOctree::BenchmarkMovingTarget()
+{
+	FBenchmarkFixture Fixture;
+	MakeBenchmarkFixture(Fixture);
+	const FOctreeBoxIndex& Boxes = Fixture.Boxes;
+	const FLinearOctree& Linear = *Fixture.Linear;
+	const FBox& VolumeBounds = Fixture.VolumeBounds;
+	FRandomStream& Random = Fixture.Random;
+	const std::atomic<bool>& ThreadIsPaused = Fixture.ThreadIsPaused;
+	const bool& NoDebug = Fixture.NoDebug;
+
+	//A few chases. The target wanders a quarter of a min size node per query, the agent moves as far along the path it got back.
+	//Where the agent goes depends on its paths, so every run chases from the same starts but not along the same route.
+	constexpr int32 ChaseCount = 8;
+	const int32 QueriesPerChase = FMath::Max(1, BenchmarkPathCount / ChaseCount);
+	const float AgentStep = MinNodeSize * 0.25f;
+
+	TArray<FVector> Starts;
+	TArray<FVector> Ends;
+	for (int32 Chase = 0; Chase < ChaseCount; Chase++)
+	{
+		Starts.Add(Random.RandPointInBox(VolumeBounds));
+		FVector End = Random.RandPointInBox(VolumeBounds);
+
+		for (int32 Query = 0; Query < QueriesPerChase; Query++)
+		{
+			End = VolumeBounds.GetClosestPointTo(End + Random.GetUnitVector() * MinNodeSize * 0.25f);
+			Ends.Add(End);
+		}
+	}
+
+	TArray<FVector> PathPoints;
+
+	//Runs every chase with the search given, returns how many queries found a path and the slowest query.
+	auto Chase = [&](TFunctionRef<bool(const FVector&, const FVector&)> Search, double& OutWorstTime)
+	{
+		int32 Found = 0;
+		OutWorstTime = 0;
+
+		for (int32 ChaseIndex = 0; ChaseIndex < ChaseCount; ChaseIndex++)
+		{
+			FVector Agent = Starts[ChaseIndex];
+
+			for (int32 Query = 0; Query < QueriesPerChase; Query++)
+			{
+				PathPoints.Reset();
+				const double Begin = FPlatformTime::Seconds();
+				const bool PathFound = Search(Agent, Ends[ChaseIndex * QueriesPerChase + Query]);
+				OutWorstTime = FMath::Max(OutWorstTime, FPlatformTime::Seconds() - Begin);
+				Found += PathFound;
+
+				if (PathFound && !PathPoints.IsEmpty())
+				{
+					const FVector ToNext = PathPoints[0] - Agent;
+					Agent += ToNext.GetClampedToMaxSize(AgentStep);
+				}
+			}
+		}
+
+		return Found;
+	};
+
+	for (const EOctreeBackend PathBackend : {EOctreeBackend::Pointer, EOctreeBackend::Linear})
+	{
+		const TCHAR* BackendName = PathBackend == EOctreeBackend::Linear ? TEXT("Linear") : TEXT("Pointer");
+		TSharedPtr<FOctreeNodeArena> PointerArena = MakeNodeArena();
+
+		//Divides the pointer tree along the chases first, so neither run pays for that.
+		if (PathBackend == EOctreeBackend::Pointer)
+		{
+			FLazyOctreeSearchContext WarmContext;
+			double WarmTime;
+			Chase([&](const FVector& Start, const FVector& End)
+			{
+				return OctreeGraph::LazyOctreeAStar(ThreadIsPaused, NoDebug, Boxes, MinNodeSize, Start, End, *PointerArena, WarmContext, PathPoints);
+			}, WarmTime);
+		}
+
+		for (const bool Incremental : {false, true})
+		{
+			FOctreePathSettings Settings = GetPathSettings();
+			Settings.Incremental = Incremental;
+			//Complete paths only, a budget would cap the from scratch searches.
+			Settings.TimeBudget = FLT_MAX;
+			Settings.ExpansionBudget = 0;
+
+			FLazyOctreeSearchContext LazyContext;
+			FLinearOctreeSearchScratch Scratch;
+
+			double WorstTime;
+			const double RunBegin = FPlatformTime::Seconds();
+
+			const int32 Found = Chase([&](const FVector& Start, const FVector& End)
+			{
+				return PathBackend == EOctreeBackend::Linear
+					       ? OctreeGraph::LinearOctreeAStar(ThreadIsPaused, NoDebug, Linear, Scratch, Start, End, PathPoints, Settings)
+					       : OctreeGraph::LazyOctreeAStar(ThreadIsPaused, NoDebug, Boxes, MinNodeSize, Start, End, *PointerArena, LazyContext, PathPoints, Settings);
+			}, WorstTime);
+
+			const double Time = FPlatformTime::Seconds() - RunBegin;
+
+			UE_LOG(LogTemp, Warning, TEXT("%s, %s, %i queries over %i chases: %f ms avg., %f ms worst. %i found."), BackendName,
+			       Incremental ? TEXT("incremental") : TEXT("from scratch"), Ends.Num(), ChaseCount, Time * 1000.0 / Ends.Num(),
+			       WorstTime * 1000.0, Found);
+		}
+	}
+}
+
+void AOctree::BenchmarkFlowField()
+{
+	FBenchmarkFixture Fixture;
+	MakeBenchmarkFixture(Fixture);
+	const FLinearOctree& Linear = *Fixture.Linear;
+	const std::atomic<bool>& ThreadIsPaused = Fixture.ThreadIsPaused;
+	const bool& NoDebug = Fixture.NoDebug;
+
+	const FVector Target = Fixture.Random.RandPointInBox(Fixture.VolumeBounds);
+
+	TArray<FVector> Agents;
+	Agents.SetNumUninitialized(BenchmarkAgentCount);
+	for (FVector& Agent : Agents)
+	{
+		Agent = Fixture.Random.RandPointInBox(Fixture.VolumeBounds);
+	}
+
+	//One search per agent, the way the agents query the workers without a flow field.
+	FOctreePathSettings Settings = GetPathSettings();
+	Settings.Incremental = false;
+	Settings.TimeBudget = FLT_MAX;
+	Settings.ExpansionBudget = 0;
+
+	FLinearOctreeSearchScratch Scratch;
+	TArray<FVector> PathPoints;
+	int32 SearchFound = 0;
+
+	double Begin = FPlatformTime::Seconds();
+	for (const FVector& Agent : Agents)
+	{
+		PathPoints.Reset();
+		SearchFound += OctreeGraph::LinearOctreeAStar(ThreadIsPaused, NoDebug, Linear, Scratch, Agent, Target, PathPoints, Settings);
+	}
+	const double SearchTime = FPlatformTime::Seconds() - Begin;
+
+	//One field, then a lookup per agent.
+	FLinearOctreeFlowField Field(Linear);
+	Field.SetTarget(Target);
+
+	Begin = FPlatformTime::Seconds();
+	Field.Refresh(ThreadIsPaused, NoDebug);
+	const double FieldTime = FPlatformTime::Seconds() - Begin;
+
+	int32 FieldFound = 0;
+	FVector NextLocation;
+
+	Begin = FPlatformTime::Seconds();
+	for (const FVector& Agent : Agents)
+	{
+		FieldFound += Field.GetNextLocation(Agent, Target, NextLocation);
+	}
+	const double LookupTime = FPlatformTime::Seconds() - Begin;
+
+	UE_LOG(LogTemp, Warning, TEXT("%i agents, one search each: %f ms. %i found."), Agents.Num(), SearchTime * 1000.0, SearchFound);
+	UE_LOG(LogTemp, Warning, TEXT("%i agents, flow field: %f ms to build, %f us per lookup, %llu KB. %i found."), Agents.Num(), FieldTime * 1000.0,
+	       LookupTime * 1000000.0 / Agents.Num(), static_cast<uint64>(Field.GetAllocatedSize() / 1024), FieldFound);
+}
@@ -0,0 +1,317 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/OctreeBoxIndex.h"
+
+//A box touching more cells than this is checked for every query instead of being registered in all of them.
+static constexpr int32 MaxCellsPerBox = 64;
+
+//Keeps big levels with tiny boxes from ending up with millions of mostly empty cells.
+static constexpr int32 MaxCellCount = 1 << 18;
+
+void FOctreeBoxIndex::Build(const TArray<FBox>& InBoxes)
+{
+	Boxes = InBoxes;
+	LargeBoxes.Reset();
+	CellStarts.Reset();
+	CellBoxes.Reset();
+	GridBounds = FBox(ForceInit);
+	GridSize = FIntVector::ZeroValue;
+
+	if (Boxes.IsEmpty())
+	{
+		return;
+	}
+
+	TArray<double> BoxSizes;
+	BoxSizes.Reserve(Boxes.Num());
+	for (const FBox& Box : Boxes)
+	{
+		GridBounds += Box;
+		BoxSizes.Add(Box.GetSize().GetMax());
+	}
+
+	//Cells about the size of a typical box, so most boxes land in a few cells and most cells hold a few boxes.
+	BoxSizes.Sort();
+	CellSize = FMath::Max(BoxSizes[BoxSizes.Num() / 2], 1.0);
+
+	const FVector GridExtent = GridBounds.GetSize();
+	while (true)
+	{
+		GridSize = FIntVector(FMath::Max(1, FMath::CeilToInt32(GridExtent.X / CellSize)),
+		                      FMath::Max(1, FMath::CeilToInt32(GridExtent.Y / CellSize)),
+		                      FMath::Max(1, FMath::CeilToInt32(GridExtent.Z / CellSize)));
+
+		if (static_cast<int64>(GridSize.X) * GridSize.Y * GridSize.Z <= MaxCellCount) break;
+
+		CellSize *= 2;
+	}
+
+	const int32 CellCount = GridSize.X * GridSize.Y * GridSize.Z;
+
+	auto IsLargeBox = [](const FIntVector& Min, const FIntVector& Max)
+	{
+		return static_cast<int64>(Max.X - Min.X + 1) * (Max.Y - Min.Y + 1) * (Max.Z - Min.Z + 1) > MaxCellsPerBox;
+	};
+
+	//First pass counts the boxes per cell, the second one fills them in. Cell i's count is stored at i + 1 so the prefix sum gives the starts.
+	CellStarts.SetNumZeroed(CellCount + 1);
+
+	for (int32 BoxIndex = 0; BoxIndex < Boxes.Num(); BoxIndex++)
+	{
+		FIntVector Min, Max;
+		GetCellRange(Boxes[BoxIndex], Min, Max);
+
+		if (IsLargeBox(Min, Max))
+		{
+			LargeBoxes.Add(BoxIndex);
+			continue;
+		}
+
+		for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+		{
+			for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+			{
+				for (int32 X = Min.X; X <= Max.X; X++)
+				{
+					CellStarts[GetCellIndex(X, Y, Z) + 1]++;
+				}
+			}
+		}
+	}
+
+	for (int32 Cell = 1; Cell <= CellCount; Cell++)
+	{
+		CellStarts[Cell] += CellStarts[Cell - 1];
+	}
+
+	CellBoxes.SetNumUninitialized(CellStarts[CellCount]);
+	TArray<int32> CellCursors(CellStarts.GetData(), CellCount);
+
+	for (int32 BoxIndex = 0; BoxIndex < Boxes.Num(); BoxIndex++)
+	{
+		FIntVector Min, Max;
+		GetCellRange(Boxes[BoxIndex], Min, Max);
+
+		if (IsLargeBox(Min, Max)) continue;
+
+		for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+		{
+			for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+			{
+				for (int32 X = Min.X; X <= Max.X; X++)
+				{
+					CellBoxes[CellCursors[GetCellIndex(X, Y, Z)]++] = BoxIndex;
+				}
+			}
+		}
+	}
+}
+
+void FOctreeBoxIndex::SetDynamicBox(const int32 Id, const FBox& Box)
+{
+	DynamicBoxes.Add(Id, Box);
+}
+
+void FOctreeBoxIndex::RemoveDynamicBox(const int32 Id)
+{
+	DynamicBoxes.Remove(Id);
+}
+
+bool FOctreeBoxIndex::GetCellRange(const FBox& Box, FIntVector& OutMin, FIntVector& OutMax) const
+{
+	if (!GridBounds.IsValid || !GridBounds.Intersect(Box))
+	{
+		return false;
+	}
+
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		OutMin[Axis] = FMath::Clamp(FMath::FloorToInt32((Box.Min[Axis] - GridBounds.Min[Axis]) / CellSize), 0, GridSize[Axis] - 1);
+		OutMax[Axis] = FMath::Clamp(FMath::FloorToInt32((Box.Max[Axis] - GridBounds.Min[Axis]) / CellSize), 0, GridSize[Axis] - 1);
+	}
+
+	return true;
+}
+
+FOctreeBoxIndex::EOverlap FOctreeBoxIndex::Classify(const FBox& NodeBox) const
+{
+	bool FoundIntersection = false;
+
+	//Returns true if the node is inside the box, there is no need to look any further in that case.
+	auto TestBox = [&NodeBox, &FoundIntersection](const FBox& Box)
+	{
+		if (Box.IsInside(NodeBox)) return true;
+
+		FoundIntersection |= NodeBox.Intersect(Box);
+		return false;
+	};
+
+	for (const TPair<int32, FBox>& Dynamic : DynamicBoxes)
+	{
+		if (TestBox(Dynamic.Value)) return EOverlap::Inside;
+	}
+
+	FIntVector Min, Max;
+	if (!GetCellRange(NodeBox, Min, Max))
+	{
+		return FoundIntersection ? EOverlap::Intersects : EOverlap::None;
+	}
+
+	const int64 CellCount = static_cast<int64>(Max.X - Min.X + 1) * (Max.Y - Min.Y + 1) * (Max.Z - Min.Z + 1);
+
+	//Nodes close to the root cover most of the grid. Walking their cells would cost more than looking at every box once.
+	if (CellCount > CellBoxes.Num())
+	{
+		for (const FBox& Box : Boxes)
+		{
+			if (TestBox(Box)) return EOverlap::Inside;
+		}
+
+		return FoundIntersection ? EOverlap::Intersects : EOverlap::None;
+	}
+
+	for (const int32 BoxIndex : LargeBoxes)
+	{
+		if (TestBox(Boxes[BoxIndex])) return EOverlap::Inside;
+	}
+
+	//A box registered in several cells can be tested more than once. That is cheaper than keeping track of which ones were seen.
+	for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+	{
+		for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+		{
+			for (int32 X = Min.X; X <= Max.X; X++)
+			{
+				const int32 Cell = GetCellIndex(X, Y, Z);
+
+				for (int32 i = CellStarts[Cell]; i < CellStarts[Cell + 1]; i++)
+				{
+					if (TestBox(Boxes[CellBoxes[i]])) return EOverlap::Inside;
+				}
+			}
+		}
+	}
+
+	return FoundIntersection ? EOverlap::Intersects : EOverlap::None;
+}
+
+bool FOctreeBoxIndex::IsSegmentClear(const FVector& From, const FVector& To, const float Radius) const
+{
+	const FVector Delta = To - From;
+
+	//Growing the boxes instead of the segment. Slightly conservative at the corners, which is fine for keeping an agent clear.
+	auto HitsBox = [&](const FBox& Box)
+	{
+		return FMath::LineBoxIntersection(Box.ExpandBy(Radius), From, To, Delta);
+	};
+
+	for (const int32 BoxIndex : LargeBoxes)
+	{
+		if (HitsBox(Boxes[BoxIndex])) return false;
+	}
+
+	for (const TPair<int32, FBox>& Dynamic : DynamicBoxes)
+	{
+		if (HitsBox(Dynamic.Value)) return false;
+	}
+
+	//One piece per cell length, each only looks at the cells around it. A long diagonal would otherwise cover most of the grid.
+	const int32 PieceCount = FMath::Max(1, FMath::CeilToInt32(Delta.Size() / CellSize));
+	const FVector Extent = FVector(Radius);
+
+	for (int32 Piece = 0; Piece < PieceCount; Piece++)
+	{
+		const FVector PieceStart = From + Delta * (static_cast<double>(Piece) / PieceCount);
+		const FVector PieceEnd = From + Delta * (static_cast<double>(Piece + 1) / PieceCount);
+
+		FIntVector Min, Max;
+		if (!GetCellRange(FBox(PieceStart.ComponentMin(PieceEnd) - Extent, PieceStart.ComponentMax(PieceEnd) + Extent), Min, Max)) continue;
+
+		for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+		{
+			for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+			{
+				for (int32 X = Min.X; X <= Max.X; X++)
+				{
+					const int32 Cell = GetCellIndex(X, Y, Z);
+
+					for (int32 i = CellStarts[Cell]; i < CellStarts[Cell + 1]; i++)
+					{
+						if (HitsBox(Boxes[CellBoxes[i]])) return false;
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool FOctreeBoxIndex::Raycast(const FVector& From, const FVector& To, const float Radius, float& OutTime, FBox& OutBox) const
+{
+	const FVector Delta = To - From;
+	const FVector Extent = FVector(Radius);
+	OutTime = 1.0f;
+	bool Hit = false;
+
+	//Sweeping a box of the radius, same as growing the boxes in IsSegmentClear().
+	auto TestBox = [&](const FBox& Box)
+	{
+		FVector HitLocation, HitNormal;
+		float HitTime;
+		if (FMath::LineExtentBoxIntersection(Box, From, To, Extent, HitLocation, HitNormal, HitTime) && (!Hit || HitTime < OutTime))
+		{
+			Hit = true;
+			OutTime = HitTime;
+			OutBox = Box;
+		}
+	};
+
+	for (const int32 BoxIndex : LargeBoxes)
+	{
+		TestBox(Boxes[BoxIndex]);
+	}
+
+	for (const TPair<int32, FBox>& Dynamic : DynamicBoxes)
+	{
+		TestBox(Dynamic.Value);
+	}
+
+	const int32 PieceCount = FMath::Max(1, FMath::CeilToInt32(Delta.Size() / CellSize));
+
+	for (int32 Piece = 0; Piece < PieceCount; Piece++)
+	{
+		//Every hit before the start of this piece was in the cells of an earlier one, so nothing can beat it anymore.
+		if (Hit && OutTime <= static_cast<float>(Piece) / PieceCount) break;
+
+		const FVector PieceStart = From + Delta * (static_cast<double>(Piece) / PieceCount);
+		const FVector PieceEnd = From + Delta * (static_cast<double>(Piece + 1) / PieceCount);
+
+		FIntVector Min, Max;
+		if (!GetCellRange(FBox(PieceStart.ComponentMin(PieceEnd) - Extent, PieceStart.ComponentMax(PieceEnd) + Extent), Min, Max)) continue;
+
+		for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+		{
+			for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+			{
+				for (int32 X = Min.X; X <= Max.X; X++)
+				{
+					const int32 Cell = GetCellIndex(X, Y, Z);
+
+					for (int32 i = CellStarts[Cell]; i < CellStarts[Cell + 1]; i++)
+					{
+						TestBox(Boxes[CellBoxes[i]]);
+					}
+				}
+			}
+		}
+	}
+
+	return Hit;
+}
+
+SIZE_T FOctreeBoxIndex::GetAllocatedSize() const
+{
+	return Boxes.GetAllocatedSize() + LargeBoxes.GetAllocatedSize() + CellStarts.GetAllocatedSize() + CellBoxes.GetAllocatedSize() +
+		DynamicBoxes.GetAllocatedSize();
+}
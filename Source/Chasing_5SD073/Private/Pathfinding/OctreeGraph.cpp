@@ -3,8 +3,9 @@
 
 #include "Pathfinding/OctreeGraph.h"
 
-#include <queue>
-#include <vector>
+#include "Algo/Reverse.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/ScopeRWLock.h"
 #include "Pathfinding/OctreeNode.h"
 
 OctreeGraph::OctreeGraph()
@@ -18,250 +19,1575 @@ OctreeGraph::~OctreeGraph()
 }
 
 TArray<double> OctreeGraph::TimeTaken;
+FCriticalSection OctreeGraph::TimeTakenLock;
 
-//This will not work in multiple pathfinding agent situations. It is a quick fix for the current situation.
-TWeakPtr<OctreeNode> OctreeGraph::PreviousValidStart = nullptr;
-TWeakPtr<OctreeNode> OctreeGraph::PreviousValidEnd = nullptr;
 
 
-//Can do weighted H to increase performance. Higher numbers should yield faster path finding but might sacrifice accuracy.
-static float ExtraHWeight = 3.0f;
-static float MaxPathfindingTime = 1.0f;
 
+bool OctreeGraph::LazyOctreeAStar(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FOctreeBoxIndex& ActorBoxes, const float& MinSize,
+                                  const FVector& StartLocation, const FVector& EndLocation, FOctreeNodeArena& Arena,
+                                  FLazyOctreeSearchContext& Context, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings)
+{
+	bool PathFound;
+	{
+		//Any number of searches at once, but no obstacle update while one of them runs.
+		FReadScopeLock SearchScope(Arena.OccupancyLock);
+
+		//Every node this search gets is stamped with its own epoch. Carrying on a kept tree, the search also holds the nodes of
+		//the earlier ones, so it enters the epoch the tree was started at.
+		Context.Epoch = Arena.NewEpoch();
+		const FOctreeEpochScope EpochScope(Arena, Context.HasTree ? FMath::Min(Context.TreeEpoch, Context.Epoch) : Context.Epoch);
+		PathFound = FindLazyOctreePath(ThreadIsPaused, Debug, ActorBoxes, MinSize, StartLocation, EndLocation, Arena, Context, OutPathList, Settings);
+	}
+
+	if (Arena.MemoryBudget == 0)
+	{
+		return PathFound;
+	}
+
+	//Over budget, a little of the least recently used part of the tree goes after every search. The other searches keep running,
+	//and if one of them holds the divide lock right now, the next search evicts instead of this one waiting.
+	FReadScopeLock EvictionScope(Arena.OccupancyLock);
+	if (!Arena.DivideLock.TryLock())
+	{
+		return PathFound;
+	}
+
+	const int32 EvictedCount = Arena.EvictOverBudget();
+	if (Debug && EvictedCount > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Octree eviction. Freed %i nodes. %i nodes and %i search data left, %llu of %llu KB used, %llu KB reserved."),
+		       EvictedCount, Arena.NumNodes(), Arena.NumPathfindingData(), static_cast<uint64>(Arena.GetUsedSize() / 1024),
+		       static_cast<uint64>(Arena.MemoryBudget / 1024), static_cast<uint64>(Arena.GetAllocatedSize() / 1024));
+	}
+
+	Arena.DivideLock.Unlock();
+	return PathFound;
+}
+
+bool OctreeGraph::FindLazyOctreePath(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FOctreeBoxIndex& ActorBoxes, const float& MinSize,
+                                     const FVector& StartLocation, const FVector& EndLocation, FOctreeNodeArena& Arena,
+                                     FLazyOctreeSearchContext& Context, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	OctreeNode* Start;
+	OctreeNode* End;
+	FVector SnappedStart = StartLocation;
+	FVector SnappedEnd = EndLocation;
+	bool Snapped = false;
+	{
+		FScopeLock DivideScope(&Arena.DivideLock);
+
+		OctreeNode* RootNode = Arena.GetRoot();
+		Start = RootNode->LazyDivideAndFindNode(ThreadIsPaused, Arena, ActorBoxes, MinSize, StartLocation, false);
+		End = RootNode->LazyDivideAndFindNode(ThreadIsPaused, Arena, ActorBoxes, MinSize, EndLocation, false);
+		if (Start != nullptr) Context.MarkInUse(Start);
+		if (End != nullptr) Context.MarkInUse(End);
+
+		if (Settings.SnapRadius > 0)
+		{
+			auto Snap = [&](const OctreeNode* Node, const FVector& Location, FVector& OutLocation)
+			{
+				if (Node != nullptr && !Node->Occupied) return false;
+
+				//Nothing else uses the scratch leaves until the search itself starts.
+				Context.FaceLeaves.Reset();
+				FindNearestFreeLeaves(ThreadIsPaused, Arena, ActorBoxes, MinSize, Location, Settings.SnapRadius, 1, Context.FaceLeaves);
+				if (Context.FaceLeaves.IsEmpty()) return false;
+
+				const OctreeNode* Leaf = Context.FaceLeaves[0];
+				OutLocation = SnapIntoLeaf(FBox::BuildAABB(Leaf->Position, FVector(Leaf->HalfSize)), Location);
+				return true;
+			};
+
+			Snapped |= Snap(Start, StartLocation, SnappedStart);
+			Snapped |= Snap(End, EndLocation, SnappedEnd);
+		}
+
+		if (!Snapped && (Start == nullptr || End == nullptr))
+		{
+			if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or End is out of bounds."));
+			return false;
+		}
+
+		if (!Snapped && IsKnownUnreachable(Arena, Start, End))
+		{
+			if (Debug) UE_LOG(LogTemp, Warning, TEXT("End cannot be reached from the start, an earlier search flooded the start's free space."));
+			return false;
+		}
+
+		if (!Snapped)
+		{
+			Arena.GetOrAddPathfindingData(*Start);
+			Arena.GetOrAddPathfindingData(*End);
+		}
+	}
+
+	//Searched again from the free space. Without snapping again, so it cannot go around in circles.
+	if (Snapped)
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or end is inside the geometry, moved to the nearest free leaf."));
+
+		FOctreePathSettings SnappedSettings = Settings;
+		SnappedSettings.SnapRadius = 0;
+		return FindLazyOctreePath(ThreadIsPaused, Debug, ActorBoxes, MinSize, SnappedStart, SnappedEnd, Arena, Context, OutPathList, SnappedSettings);
+	}
+
+	float PathfindingTimer = FPlatformTime::Seconds();
+
+	//Incremental replanning. From the same start leaf, the tree of the previous query is still valid, only the end moved.
+	//From a node the tree expanded, the tree is rerooted there first.
+	const bool KeepTree = Settings.Incremental && Context.HasTree && Context.TreeRevision == Arena.Revision && Context.TreeEpoch > Arena.EvictedEpoch;
+	const bool Reroot = KeepTree && Context.TreeStart.Get() != Start && Context.WasReached(Start) &&
+		Context.WasExpanded(Context.Records[Context.GetRecordIndex(Start)]);
+	const bool Resume = KeepTree && (Context.TreeStart.Get() == Start || Reroot);
+	if (!Resume)
+	{
+		//Until the start is in the new tree.
+		Context.HasTree = false;
+		Context.BeginSearch();
+	}
+
+	const uint32 Stamp = Context.Stamp;
+	const bool EndWasReached = Resume && Context.WasReached(End);
+
+	//In case we are using an occupied node as an end, we force finding neighbors here,
+	//As the start will get their neighbor called anyway due to how Current Node works
+	//But the End will never be neighbor of any if it is occupied.
+	//Hence, forcing it here to have neighbors.
+	//A resumed tree needs them for any end it did not reach yet, all of its neighbors might have been expanded already.
+	if (End->Occupied || (Resume && !EndWasReached))
+	{
+		if (!CollectNeighbors(ThreadIsPaused, Arena, End, ActorBoxes, MinSize, Context))
+		{
+			if (Debug) UE_LOG(LogTemp, Warning, TEXT("End node is inaccessible."));
+			return false; //End node is inaccessible.
+		}
+	}
+
+	OctreeNode* PreviousEnd = Context.TreeEnd.Get();
+	Context.TreeEnd = End;
+
+	//An anytime search starts over with a fast path whenever the end moves to another leaf, and keeps improving it while it does not.
+	if (!Resume || !Settings.Anytime || PreviousEnd != End)
+	{
+		Context.Weight = Settings.HeuristicWeight;
+	}
+
+	//Any-angle paths are measured in straight lines between the actual start and end locations, which is what the line of sight is tested on.
+	auto GetPosition = [&](const OctreeNode* Node) -> const FVector&
+	{
+		return Node == Start ? StartLocation : Node == End ? EndLocation : Node->Position;
+	};
+
+	auto Distance = [&](const OctreeNode* From, const OctreeNode* To)
+	{
+		return Settings.AnyAngle ? FVector::Dist(GetPosition(From), GetPosition(To)) : ManhattanDistance(From, To);
+	};
+
+	//Once the end is expanded, the path is in the tree. Out of budget, the path goes to the expanded node closest to the end instead.
+	//A resumed search checks the parts the old tree could not know about.
+	const int32 StartIndex = Context.GetRecordIndex(Start);
+	const int32 FirstPathPoint = OutPathList.Num();
+	auto FinishPath = [&](const int32 TargetIndex, const bool TargetWasExpanded)
+	{
+		const OctreeNode* Target = Context.Records[TargetIndex].Node;
+		const FVector& TargetLocation = Target == End ? EndLocation : Target->Position;
+
+		const int32 FirstNewPoint = OutPathList.Num();
+		if (Settings.Funnel && !Settings.AnyAngle)
+		{
+			//The faces along the path, gathered from the end like ReconstructPath() does, then flipped.
+			Context.Portals.Reset();
+			for (int32 Index = TargetIndex; Index != StartIndex && Context.Records[Index].CameFrom != INDEX_NONE; Index = Context.Records[Index].CameFrom)
+			{
+				const OctreeNode* Node = Context.Records[Index].Node;
+				const OctreeNode* CameFrom = Context.Records[Context.Records[Index].CameFrom].Node;
+				Context.Portals.Add(GetPortal(FBox::BuildAABB(CameFrom->Position, FVector(CameFrom->HalfSize)),
+				                              FBox::BuildAABB(Node->Position, FVector(Node->HalfSize)), Settings.AgentRadius));
+			}
+
+			Algo::Reverse(Context.Portals);
+			PullString(StartLocation, TargetLocation, Context.Portals, Context.PortalPoints, OutPathList);
+		}
+		else
+		{
+			ReconstructPath(Context, StartIndex, TargetIndex, !Settings.AnyAngle, OutPathList);
+		}
+
+		if (Resume && Settings.AnyAngle)
+		{
+			//The tree grew from where the agent was before, which usually still sees the first corner, but not always.
+			const FVector& FirstPoint = OutPathList.Num() > FirstNewPoint ? OutPathList[FirstNewPoint] : TargetLocation;
+			if (!ActorBoxes.IsSegmentClear(StartLocation, FirstPoint, Settings.AgentRadius))
+			{
+				OutPathList.SetNum(FirstNewPoint, EAllowShrinking::No);
+				return false;
+			}
+
+			//An end expanded as part of the tree was only seen up to its center. The center sees the whole leaf.
+			const FVector& LastPoint = OutPathList.Num() > FirstNewPoint ? OutPathList.Last() : StartLocation;
+			if (TargetWasExpanded && !ActorBoxes.IsSegmentClear(LastPoint, TargetLocation, Settings.AgentRadius))
+			{
+				OutPathList.Add(Target->Position);
+			}
+		}
+
+		OutPathList.Add(TargetLocation);
+
+		if (Debug && Target == End && Context.Weight < Settings.HeuristicWeight)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Path improved with heuristic weight %f."), Context.Weight);
+		}
+		else if (Debug && Target == End)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Path found in avg. in %f seconds"), AddTimeTaken(FPlatformTime::Seconds() - StartTime));
+		}
+		else if (Debug)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Out of search budget, returning a partial path of %i points."), OutPathList.Num() - FirstNewPoint);
+		}
+
+		return true;
+	};
+
+	auto StartOver = [&]()
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Resumed path is blocked at the start, searching again."));
+		Context.HasTree = false;
+		OutPathList.SetNum(FirstPathPoint, EAllowShrinking::No);
+		return FindLazyOctreePath(ThreadIsPaused, Debug, ActorBoxes, MinSize, StartLocation, EndLocation, Arena, Context, OutPathList, Settings);
+	};
+
+	auto RekeyOpen = [&]()
+	{
+		for (const int32 OpenIndex : Context.OpenHeap)
+		{
+			FLazyOctreeSearchContext::FSearchRecord& Record = Context.Records[OpenIndex];
+			Record.F = Record.G + Distance(Record.Node, End) * Context.Weight;
+		}
+
+		Context.Heapify();
+	};
+
+	//ARA*. The end and the inconsistent records go back to the open ones, which are sorted for the lower weight, and nothing is closed.
+	auto LowerWeight = [&](const int32 EndIndex)
+	{
+		Context.Weight = FMath::Max(Settings.FinalHeuristicWeight, Context.Weight - Settings.HeuristicWeightStep);
+		Context.Records[EndIndex].HeapIndex = Context.OpenHeap.Add(EndIndex);
+		Context.OpenInconsistent();
+		Context.BeginIteration();
+		RekeyOpen();
+	};
+
+	//The agent moved to another node of the tree. The parents between it and the old start are flipped, so every path in the tree leads
+	//to it, and every G is measured again along the parents. The expanded nodes keep the parents they got from the old start, so a path
+	//through them is not always the shortest one, but it is a path.
+	if (Reroot)
+	{
+		int32 Child = INDEX_NONE;
+		for (int32 Index = StartIndex; Index != INDEX_NONE;)
+		{
+			const int32 Parent = Context.Records[Index].CameFrom;
+			Context.Records[Index].CameFrom = Child;
+			Child = Index;
+			Index = Parent;
+		}
+
+		//A negative G is not measured yet. Every record walks up to the first one that is, then down again, so each is measured once.
+		for (FLazyOctreeSearchContext::FSearchRecord& Record : Context.Records)
+		{
+			if (Record.VisitedStamp == Stamp) Record.G = -1;
+		}
+
+		Context.Records[StartIndex].G = 0;
+
+		for (int32 RecordIndex = 0; RecordIndex < Context.Records.Num(); RecordIndex++)
+		{
+			if (Context.Records[RecordIndex].VisitedStamp != Stamp || Context.Records[RecordIndex].G >= 0) continue;
+
+			Context.Chain.Reset();
+			int32 Measured = RecordIndex;
+			for (; Measured != INDEX_NONE && Context.Records[Measured].G < 0; Measured = Context.Records[Measured].CameFrom)
+			{
+				Context.Chain.Add(Measured);
+			}
+
+			for (int32 ChainIndex = Context.Chain.Num() - 1; ChainIndex >= 0; ChainIndex--)
+			{
+				FLazyOctreeSearchContext::FSearchRecord& Record = Context.Records[Context.Chain[ChainIndex]];
+				Record.G = Measured == INDEX_NONE ? 0 : Context.Records[Measured].G + Distance(Context.Records[Measured].Node, Record.Node);
+				Measured = Context.Chain[ChainIndex];
+			}
+		}
+
+		Context.TreeStart = Start;
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start moved within the kept tree, rerooted it."));
+	}
+
+	if (Resume)
+	{
+		//The previous end was popped without being expanded, it goes back to the open nodes. Unless it was occupied, then nothing leads there.
+		if (PreviousEnd != nullptr && (!PreviousEnd->Occupied || PreviousEnd == End) && Context.WasReached(PreviousEnd))
+		{
+			const int32 PreviousEndIndex = Context.GetRecordIndex(PreviousEnd);
+			FLazyOctreeSearchContext::FSearchRecord& Record = Context.Records[PreviousEndIndex];
+
+			if (!Context.WasExpanded(Record) && Record.HeapIndex == INDEX_NONE)
+			{
+				//It was measured to the old end location.
+				if (Record.CameFrom != INDEX_NONE)
+				{
+					Record.G = Context.Records[Record.CameFrom].G + Distance(Context.Records[Record.CameFrom].Node, PreviousEnd);
+				}
+
+				Record.HeapIndex = Context.OpenHeap.Add(PreviousEndIndex);
+			}
+		}
+
+		//Every G is a distance from the start, only the heuristic changed.
+		RekeyOpen();
+
+		if (EndWasReached && Context.WasExpanded(Context.Records[Context.GetRecordIndex(End)]))
+		{
+			return FinishPath(Context.GetRecordIndex(End), true) || StartOver();
+		}
+
+		//The end is new to the tree. Its expanded neighbors are offered it as if they were expanded again, Context.Neighbors still has them.
+		if (!EndWasReached)
+		{
+			int32 BestParent = INDEX_NONE;
+			float BestG = FLT_MAX;
+			for (OctreeNode* Neighbor : Context.Neighbors)
+			{
+				if (!Context.WasReached(Neighbor)) continue;
+
+				const FLazyOctreeSearchContext::FSearchRecord& Record = Context.Records[Context.GetRecordIndex(Neighbor)];
+				if (!Context.WasExpanded(Record)) continue;
+
+				const int32 ParentIndex = Settings.AnyAngle && Record.CameFrom != INDEX_NONE ? Record.CameFrom : Context.GetRecordIndex(Neighbor);
+				const float G = Context.Records[ParentIndex].G + Distance(Context.Records[ParentIndex].Node, End);
+				if (G < BestG)
+				{
+					BestParent = ParentIndex;
+					BestG = G;
+				}
+			}
+
+			if (BestParent != INDEX_NONE)
+			{
+				const int32 EndIndex = Context.GetRecordIndex(End);
+				FLazyOctreeSearchContext::FSearchRecord& EndRecord = Context.Records[EndIndex];
+				EndRecord.Node = End;
+				EndRecord.CameFrom = BestParent;
+				EndRecord.G = BestG;
+				EndRecord.F = BestG;
+				EndRecord.VisitedStamp = Stamp;
+				Context.HeapPush(EndIndex);
+			}
+		}
+	}
+	else
+	{
+		FLazyOctreeSearchContext::FSearchRecord& StartRecord = Context.Records[StartIndex];
+		StartRecord.Node = Start;
+		StartRecord.CameFrom = INDEX_NONE;
+		StartRecord.G = 0;
+		StartRecord.F = Distance(Start, End) * Context.Weight;
+		StartRecord.VisitedStamp = Stamp;
+
+		Context.HeapPush(StartIndex);
+
+		Context.HasTree = Settings.Incremental;
+		Context.TreeStart = Start;
+		Context.TreeRevision = Arena.Revision;
+		Context.TreeEpoch = Context.Epoch;
+	}
+
+	//Closest to the end of the nodes expanded by this call, for a partial path.
+	int32 ClosestIndex = INDEX_NONE;
+	float ClosestDistance = FLT_MAX;
+	int32 Expansions = 0;
+
+	//An anytime search with a hook hands out every path it finds and keeps improving it, see FOctreePathSettings::OnPathImproved.
+	bool Improving = false;
+	float HandedOutG = FLT_MAX;
+
+	auto HasBudget = [&]()
+	{
+		return (Settings.ExpansionBudget <= 0 || Expansions < Settings.ExpansionBudget) &&
+			FPlatformTime::Seconds() - PathfindingTimer <= Settings.TimeBudget;
+	};
+
+	while (!Context.OpenHeap.IsEmpty() && !ThreadIsPaused && HasBudget())
+	{
+		const int32 CurrentIndex = Context.HeapPop();
+		OctreeNode* CurrentNode = Context.Records[CurrentIndex].Node;
+		Expansions++;
+
+		//Lazy Theta* only checks the line of sight once a node is expanded. If it is blocked, the node falls back to the best
+		//expanded neighbor as its parent, which is what plain A* would have picked.
+		bool HasNeighbors = false;
+		if (Settings.AnyAngle)
+		{
+			HasNeighbors = CollectNeighbors(ThreadIsPaused, Arena, CurrentNode, ActorBoxes, MinSize, Context);
+
+			const int32 ParentIndex = Context.Records[CurrentIndex].CameFrom;
+
+			if (ParentIndex != INDEX_NONE &&
+				!ActorBoxes.IsSegmentClear(GetPosition(Context.Records[ParentIndex].Node), GetPosition(CurrentNode), Settings.AgentRadius))
+			{
+				int32 BestIndex = INDEX_NONE;
+				float BestG = FLT_MAX;
+				for (OctreeNode* Neighbor : Context.Neighbors)
+				{
+					const int32 NeighborIndex = Context.GetRecordIndex(Neighbor);
+					const FLazyOctreeSearchContext::FSearchRecord& Record = Context.Records[NeighborIndex];
+					if (!Context.WasExpanded(Record)) continue;
+
+					const float G = Record.G + Distance(Neighbor, CurrentNode);
+					if (G < BestG)
+					{
+						BestIndex = NeighborIndex;
+						BestG = G;
+					}
+				}
+
+				//The node that reached it is always one of them, so there is a fallback unless its neighbors went stale in the meantime.
+				if (BestIndex != INDEX_NONE)
+				{
+					Context.Records[CurrentIndex].CameFrom = BestIndex;
+					Context.Records[CurrentIndex].G = BestG;
+				}
+			}
+		}
+
+		if (CurrentNode == End)
+		{
+			OutPathList.SetNum(FirstPathPoint, EAllowShrinking::No);
+			if (!FinishPath(CurrentIndex, false))
+			{
+				return StartOver();
+			}
+
+			//Anytime: the path goes back right away, and the tree is set up for the next weight. The next incremental query toward
+			//the same leaf improves it, or this one while it has budget if there is someone to hand the path to meanwhile.
+			if (Settings.Anytime && Context.Weight > Settings.FinalHeuristicWeight)
+			{
+				const float EndG = Context.Records[CurrentIndex].G;
+				LowerWeight(CurrentIndex);
+
+				if (Settings.OnPathImproved && HasBudget())
+				{
+					//A weight that found no shorter path is not worth handing out again.
+					if (EndG < HandedOutG)
+					{
+						HandedOutG = EndG;
+						Settings.OnPathImproved(TConstArrayView<FVector>(OutPathList.GetData() + FirstPathPoint, OutPathList.Num() - FirstPathPoint));
+					}
+
+					Improving = true;
+					continue;
+				}
+			}
+
+			return true;
+		}
+
+		Context.Records[CurrentIndex].ClosedStamp = Context.CloseStamp;
+
+		//Return false there are no neighbors. 
+		if (!Settings.AnyAngle)
+		{
+			HasNeighbors = CollectNeighbors(ThreadIsPaused, Arena, CurrentNode, ActorBoxes, MinSize, Context);
+		}
+
+		if (!HasNeighbors)
+		{
+			//Paused halfway through finding them. The node goes back to the open ones, so the tree can still be continued.
+			if (ThreadIsPaused)
+			{
+				Context.Records[CurrentIndex].ClosedStamp = 0;
+				Context.HeapPush(CurrentIndex);
+			}
+
+			continue;
+		}
+
+		const float DistanceToEnd = Distance(CurrentNode, End);
+		if (CurrentIndex != StartIndex && DistanceToEnd < ClosestDistance)
+		{
+			ClosestIndex = CurrentIndex;
+			ClosestDistance = DistanceToEnd;
+		}
+
+		//In an any-angle search the neighbors are first offered the parent of the current node, the line of sight is checked later.
+		const int32 ParentIndex = Settings.AnyAngle && Context.Records[CurrentIndex].CameFrom != INDEX_NONE ? Context.Records[CurrentIndex].CameFrom : CurrentIndex;
+		OctreeNode* ParentNode = Context.Records[ParentIndex].Node;
+		const float ParentG = Context.Records[ParentIndex].G;
+
+		//Not checking for a pause in here, a half expanded node would leave a hole in the tree.
+		for (OctreeNode* Neighbor : Context.Neighbors)
+		{
+			//Might grow the records, so no references to them are kept across iterations.
+			const int32 NeighborIndex = Context.GetRecordIndex(Neighbor);
+			FLazyOctreeSearchContext::FSearchRecord& Record = Context.Records[NeighborIndex];
+
+			const bool WasReached = Record.VisitedStamp == Stamp;
+			const float TentativeG = ParentG + Distance(ParentNode, Neighbor);
+
+			//G of a node from an older search does not count.
+			if (WasReached && Record.G <= TentativeG) continue;
+
+			if (Context.IsClosed(Record))
+			{
+				//ARA*: a closed node that got cheaper is expanded again with the next weight, once.
+				if (Settings.Anytime)
+				{
+					Record.CameFrom = ParentIndex;
+					Record.G = TentativeG;
+
+					if (Record.HeapIndex != FLazyOctreeSearchContext::InconsistentIndex)
+					{
+						Record.HeapIndex = FLazyOctreeSearchContext::InconsistentIndex;
+						Context.Inconsistent.Add(NeighborIndex);
+					}
+				}
+
+				continue;
+			}
+
+			Record.Node = Neighbor;
+			Record.CameFrom = ParentIndex;
+			Record.G = TentativeG;
+			Record.F = TentativeG + Distance(Neighbor, End) * Context.Weight;
+
+			//Expanded with an earlier weight of an anytime search, it is open again.
+			if (WasReached && Record.HeapIndex >= 0)
+			{
+				Context.HeapDecreaseKey(NeighborIndex);
+			}
+			else
+			{
+				Record.VisitedStamp = Stamp;
+				Context.HeapPush(NeighborIndex);
+			}
+		}
+	}
+
+	//Out of budget while improving an anytime path. The end still has the best parent it got, that path is the best one for now.
+	if (Settings.Anytime && (Resume || Improving) && !ThreadIsPaused && Context.WasReached(End))
+	{
+		OutPathList.SetNum(FirstPathPoint, EAllowShrinking::No);
+		return FinishPath(Context.GetRecordIndex(End), false) || StartOver();
+	}
+
+	//Out of budget. The open nodes are still there for the next call to carry on with, the agent gets as close as the search got.
+	if (!Context.OpenHeap.IsEmpty() && !ThreadIsPaused && ClosestIndex != INDEX_NONE)
+	{
+		return FinishPath(ClosestIndex, false) || StartOver();
+	}
+
+	//Ran out of nodes rather than budget, so the search reached all of the free space the start is connected to.
+	if (Context.OpenHeap.IsEmpty() && !ThreadIsPaused)
+	{
+		RememberFloodedComponent(Arena, Context, End);
+	}
+
+	if (Debug) UE_LOG(LogTemp, Error, TEXT("Couldn't find path"));
+	return false;
+}
+
+bool OctreeGraph::CollectNeighbors(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, OctreeNode* Node, const FOctreeBoxIndex& ActorBoxes,
+                                   const float& MinSize, FLazyOctreeSearchContext& Context)
+{
+	//The neighbor sets are shared between searches and get added to while other searches divide, so they are only read under the lock.
+	FScopeLock DivideScope(&Arena.DivideLock);
+
+	Context.Neighbors.Reset();
+
+	if (!GetNeighbors(ThreadIsPaused, Arena, Node, ActorBoxes, MinSize, Context.FaceLeaves))
+	{
+		return false;
+	}
+
+	for (const FOctreeNodeHandle& Neighbor : Node->PathfindingData->Neighbors)
+	{
+		if (OctreeNode* NeighborNode = Neighbor.Get())
+		{
+			Context.MarkInUse(NeighborNode);
+			Context.Neighbors.Add(NeighborNode);
+		}
+	}
+
+	return true;
+}
+
+double OctreeGraph::AddTimeTaken(const double Time)
+{
+	FScopeLock TimeTakenScope(&TimeTakenLock);
+
+	TimeTaken.Add(Time);
+
+	double Total = 0;
+	for (const auto PreviousTime : TimeTaken)
+	{
+		Total += PreviousTime;
+	}
+
+	return Total / TimeTaken.Num();
+}
+
+bool OctreeGraph::LinearOctreeAStar(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FLinearOctree& Octree, FLinearOctreeSearchScratch& Scratch,
+                                    const FVector& StartLocation, const FVector& EndLocation, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings)
+{
+	return FindLinearOctreePath(ThreadIsPaused, Debug, Octree, nullptr, Scratch, StartLocation, EndLocation, OutPathList, Settings);
+}
+
+bool OctreeGraph::HierarchicalLinearOctreeAStar(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FLinearOctreeHierarchy& Hierarchy,
+                                                FLinearOctreeSearchScratch& Scratch, const FVector& StartLocation, const FVector& EndLocation,
+                                                TArray<FVector>& OutPathList, const FOctreePathSettings& Settings)
+{
+	const FLinearOctree& Octree = Hierarchy.GetOctree();
+
+	const uint32 Start = Octree.FindLeaf(StartLocation);
+	const uint32 End = Octree.FindLeaf(EndLocation);
+
+	FVector SnappedStart = StartLocation;
+	FVector SnappedEnd = EndLocation;
+	//Not ||, both of them may need it.
+	if (SnapToFreeCell(Octree, Start, StartLocation, Settings.SnapRadius, SnappedStart) | SnapToFreeCell(Octree, End, EndLocation, Settings.SnapRadius, SnappedEnd))
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or end is inside the geometry, moved to the nearest free cell."));
+
+		FOctreePathSettings SnappedSettings = Settings;
+		SnappedSettings.SnapRadius = 0;
+		return HierarchicalLinearOctreeAStar(ThreadIsPaused, Debug, Hierarchy, Scratch, SnappedStart, SnappedEnd, OutPathList, SnappedSettings);
+	}
+
+	if (Start == LinearOctree::InvalidIndex || End == LinearOctree::InvalidIndex)
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or End is out of bounds."));
+		return false;
+	}
+
+	//In parts of the free space that are not connected, a search would only flood the start's part until it runs out of budget.
+	if (!MayBeConnected(Octree, Start, End, Scratch.Neighbors))
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("End cannot be reached from the start, they are in different parts of the free space."));
+		return false;
+	}
+
+	const uint32 StartCluster = Hierarchy.GetCluster(Start);
+	const uint32 EndCluster = Hierarchy.GetCluster(End);
+
+	//Close enough for the corridor to be pointless. A kept tree the start is in is also cheaper to continue than a new corridor.
+	if (StartCluster == EndCluster || (Settings.Incremental && Scratch.HasTree && (Scratch.TreeStart == Start || Scratch.WasExpanded(Start))))
+	{
+		return FindLinearOctreePath(ThreadIsPaused, Debug, Octree, nullptr, Scratch, StartLocation, EndLocation, OutPathList, Settings);
+	}
+
+	if (!FindCoarsePath(ThreadIsPaused, Hierarchy, Scratch, StartCluster, EndCluster))
+	{
+		//No portals lead there. The end might still be reachable through the neighbors of an occupied end, which the full search handles.
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("No coarse path, searching the whole octree."));
+		return FindLinearOctreePath(ThreadIsPaused, Debug, Octree, nullptr, Scratch, StartLocation, EndLocation, OutPathList, Settings);
+	}
+
+	const uint32 CorridorMark = Scratch.CoarseStamp;
+	for (const uint32 Cluster : Scratch.CoarsePath)
+	{
+		Scratch.CorridorStamp[Cluster] = CorridorMark;
+	}
+
+	const int32 FirstNewPoint = OutPathList.Num();
+	if (FindLinearOctreePath(ThreadIsPaused, Debug, Octree, &Hierarchy, Scratch, StartLocation, EndLocation, OutPathList, Settings))
+	{
+		return true;
+	}
+
+	OutPathList.SetNum(FirstNewPoint, EAllowShrinking::No);
+
+	//The path went through a cluster whose free parts are not connected. One ring of clusters around it is usually enough to get around.
+	for (const uint32 Cluster : Scratch.CoarsePath)
+	{
+		for (const uint32 Linked : Hierarchy.GetLinkedClusters(Cluster))
+		{
+			Scratch.CorridorStamp[Linked] = CorridorMark;
+		}
+	}
+
+	if (Debug) UE_LOG(LogTemp, Warning, TEXT("Corridor blocked, widening it."));
+	if (FindLinearOctreePath(ThreadIsPaused, Debug, Octree, &Hierarchy, Scratch, StartLocation, EndLocation, OutPathList, Settings))
+	{
+		return true;
+	}
+
+	OutPathList.SetNum(FirstNewPoint, EAllowShrinking::No);
+	if (Debug) UE_LOG(LogTemp, Warning, TEXT("Widened corridor blocked too, searching the whole octree."));
+	return FindLinearOctreePath(ThreadIsPaused, Debug, Octree, nullptr, Scratch, StartLocation, EndLocation, OutPathList, Settings);
+}
+
+bool OctreeGraph::FindCoarsePath(const std::atomic<bool>& ThreadIsPaused, const FLinearOctreeHierarchy& Hierarchy, FLinearOctreeSearchScratch& Scratch,
+                                 const uint32 StartCluster, const uint32 EndCluster)
+{
+	const int32 ClusterCount = Hierarchy.NumClusters();
+	if (Scratch.CoarseG.Num() < ClusterCount)
+	{
+		Scratch.CoarseG.SetNumUninitialized(ClusterCount);
+		Scratch.CoarseCameFrom.SetNumUninitialized(ClusterCount);
+		Scratch.CoarseOpenStamp.SetNumZeroed(ClusterCount);
+		Scratch.CoarseClosedStamp.SetNumZeroed(ClusterCount);
+		Scratch.CorridorStamp.SetNumZeroed(ClusterCount);
+	}
+
+	if (++Scratch.CoarseStamp == 0)
+	{
+		FMemory::Memzero(Scratch.CoarseOpenStamp.GetData(), Scratch.CoarseOpenStamp.Num() * sizeof(uint32));
+		FMemory::Memzero(Scratch.CoarseClosedStamp.GetData(), Scratch.CoarseClosedStamp.Num() * sizeof(uint32));
+		FMemory::Memzero(Scratch.CorridorStamp.GetData(), Scratch.CorridorStamp.Num() * sizeof(uint32));
+		Scratch.CoarseStamp = 1;
+	}
 
-bool OctreeGraph::LazyOctreeAStar(const bool& ThreadIsPaused, const bool& Debug, const TArray<FBox>& ActorBoxes, const float& MinSize,
-                                  const FVector& StartLocation, const FVector& EndLocation, const TSharedPtr<OctreeNode>& RootNode,
-                                  TArray<FVector>& OutPathList)
+	const uint32 Stamp = Scratch.CoarseStamp;
+	const FVector& EndCenter = Hierarchy.GetClusterCenter(EndCluster);
+
+	//Not weighted, the coarse graph is small and a straight corridor matters more than a fast one.
+	auto Distance = [](const FVector& From, const FVector& To)
+	{
+		return FMath::Abs(To.X - From.X) + FMath::Abs(To.Y - From.Y) + FMath::Abs(To.Z - From.Z);
+	};
+
+	Scratch.CoarseHeap.Reset();
+	Scratch.CoarseG[StartCluster] = 0;
+	Scratch.CoarseCameFrom[StartCluster] = LinearOctree::InvalidIndex;
+	Scratch.CoarseOpenStamp[StartCluster] = Stamp;
+	Scratch.CoarseHeap.HeapPush({Distance(Hierarchy.GetClusterCenter(StartCluster), EndCenter), StartCluster});
+
+	while (!Scratch.CoarseHeap.IsEmpty() && !ThreadIsPaused)
+	{
+		FLinearOctreeSearchScratch::FOpenEntry Entry;
+		Scratch.CoarseHeap.HeapPop(Entry);
+		const uint32 Current = Entry.Node;
+
+		if (Scratch.CoarseClosedStamp[Current] == Stamp) continue;
+
+		if (Current == EndCluster)
+		{
+			Scratch.CoarsePath.Reset();
+			for (uint32 Cluster = EndCluster; Cluster != LinearOctree::InvalidIndex; Cluster = Scratch.CoarseCameFrom[Cluster])
+			{
+				Scratch.CoarsePath.Add(Cluster);
+			}
+
+			return true;
+		}
+
+		Scratch.CoarseClosedStamp[Current] = Stamp;
+		const FVector& CurrentCenter = Hierarchy.GetClusterCenter(Current);
+
+		for (const uint32 Linked : Hierarchy.GetLinkedClusters(Current))
+		{
+			if (Scratch.CoarseClosedStamp[Linked] == Stamp) continue;
+
+			const FVector& LinkedCenter = Hierarchy.GetClusterCenter(Linked);
+			const float TentativeG = Scratch.CoarseG[Current] + Distance(CurrentCenter, LinkedCenter);
+
+			if (Scratch.CoarseOpenStamp[Linked] == Stamp && Scratch.CoarseG[Linked] <= TentativeG) continue;
+
+			Scratch.CoarseOpenStamp[Linked] = Stamp;
+			Scratch.CoarseG[Linked] = TentativeG;
+			Scratch.CoarseCameFrom[Linked] = Current;
+			Scratch.CoarseHeap.HeapPush({TentativeG + Distance(LinkedCenter, EndCenter), Linked});
+		}
+	}
+
+	return false;
+}
+
+bool OctreeGraph::FindLinearOctreePath(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FLinearOctree& Octree, const FLinearOctreeHierarchy* Corridor,
+                                       FLinearOctreeSearchScratch& Scratch, const FVector& StartLocation, const FVector& EndLocation,
+                                       TArray<FVector>& OutPathList, const FOctreePathSettings& Settings)
 {
 	const double StartTime = FPlatformTime::Seconds();
 
+	const uint32 Start = Octree.FindLeaf(StartLocation);
+	const uint32 End = Octree.FindLeaf(EndLocation);
+
+	FVector SnappedStart = StartLocation;
+	FVector SnappedEnd = EndLocation;
+	//Not ||, both of them may need it.
+	if (SnapToFreeCell(Octree, Start, StartLocation, Settings.SnapRadius, SnappedStart) | SnapToFreeCell(Octree, End, EndLocation, Settings.SnapRadius, SnappedEnd))
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or end is inside the geometry, moved to the nearest free cell."));
+
+		FOctreePathSettings SnappedSettings = Settings;
+		SnappedSettings.SnapRadius = 0;
+		return FindLinearOctreePath(ThreadIsPaused, Debug, Octree, Corridor, Scratch, SnappedStart, SnappedEnd, OutPathList, SnappedSettings);
+	}
+
+	if (Start == LinearOctree::InvalidIndex || End == LinearOctree::InvalidIndex)
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or End is out of bounds."));
+		return false;
+	}
+
+	//In parts of the free space that are not connected, a search would only flood the start's part until it runs out of budget.
+	if (!MayBeConnected(Octree, Start, End, Scratch.Neighbors))
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("End cannot be reached from the start, they are in different parts of the free space."));
+		return false;
+	}
+
+	//The octree never changes, so the scratch arrays only grow the first time. Bumping the stamp invalidates the previous search.
+	if (Scratch.G.Num() < Octree.NumCells())
+	{
+		Scratch.G.SetNumUninitialized(Octree.NumCells());
+		Scratch.CameFrom.SetNumUninitialized(Octree.NumCells());
+		Scratch.OpenStamp.SetNumZeroed(Octree.NumCells());
+		Scratch.ClosedStamp.SetNumZeroed(Octree.NumCells());
+	}
+
+	//Incremental replanning, same as in LazyOctreeAStar. The octree never changes, so the tree only depends on its start.
+	//A corridor search skips cells, so its tree cannot be continued toward another end.
+	const bool KeepTree = Settings.Incremental && Corridor == nullptr && Scratch.HasTree;
+	const bool Reroot = KeepTree && Scratch.TreeStart != Start && Scratch.WasExpanded(Start);
+	const bool Resume = KeepTree && (Scratch.TreeStart == Start || Reroot);
+	if (!Resume)
+	{
+		//Until the start is in the new tree.
+		Scratch.HasTree = false;
+		Scratch.BeginSearch();
+	}
+
+	const uint32 Stamp = Scratch.Stamp;
+
+	//Same as in LazyOctreeAStar, an occupied end will never be anyone's neighbor, so we remember who it would be a neighbor of.
+	TArray<uint32> EndNeighbors;
+	if (Octree.IsOccupied(End))
+	{
+		Octree.GetNeighbors(End, EndNeighbors);
+		if (EndNeighbors.IsEmpty())
+		{
+			if (Debug) UE_LOG(LogTemp, Warning, TEXT("End node is inaccessible."));
+			return false;
+		}
+	}
+
+	const uint32 PreviousEnd = Scratch.TreeEnd;
+	Scratch.TreeEnd = End;
+
+	//Same as in LazyOctreeAStar, a new end leaf gets a fast path first.
+	if (!Resume || !Settings.Anytime || PreviousEnd != End)
+	{
+		Scratch.Weight = Settings.HeuristicWeight;
+	}
+
+	//Any-angle paths are measured in straight lines between the actual start and end locations, which is what the line of sight is tested on.
+	auto GetPosition = [&](const uint32 Cell)
+	{
+		return Settings.AnyAngle && Cell == Start ? StartLocation : Settings.AnyAngle && Cell == End ? EndLocation : Octree.GetNodeCenter(Cell);
+	};
+
+	auto Distance = [&](const FVector& From, const FVector& To)
+	{
+		return Settings.AnyAngle
+			       ? FVector::Dist(From, To)
+			       : FMath::Abs(To.X - From.X) + FMath::Abs(To.Y - From.Y) + FMath::Abs(To.Z - From.Z);
+	};
+
+	const FVector EndPosition = GetPosition(End);
+
+	//Walking back from the end, then flipping it, instead of inserting at the front every time.
+	//A resumed search checks the parts the old tree could not know about, same as in LazyOctreeAStar.
+	//Out of budget, the path goes to the expanded cell closest to the end instead.
+	const int32 FirstPathPoint = OutPathList.Num();
+	auto FinishPath = [&](const uint32 Target, const bool TargetWasExpanded)
+	{
+		const FVector TargetLocation = Target == End ? EndLocation : Octree.GetNodeCenter(Target);
+
+		const int32 FirstNewPoint = OutPathList.Num();
+		uint32 Previous = Target;
+		uint32 CameFrom = Scratch.CameFrom[Target];
+
+		if (Settings.Funnel && !Settings.AnyAngle)
+		{
+			//Same as in LazyOctreeAStar, the faces from the end back, flipped.
+			Scratch.Portals.Reset();
+			for (; Previous != Start && CameFrom != LinearOctree::InvalidIndex; Previous = CameFrom, CameFrom = Scratch.CameFrom[CameFrom])
+			{
+				Scratch.Portals.Add(GetPortal(Octree.GetNodeBox(CameFrom), Octree.GetNodeBox(Previous), Settings.AgentRadius));
+			}
+
+			Algo::Reverse(Scratch.Portals);
+			PullString(StartLocation, TargetLocation, Scratch.Portals, Scratch.PortalPoints, OutPathList);
+		}
+		else
+		{
+			while (CameFrom != LinearOctree::InvalidIndex && CameFrom != Start)
+			{
+				const FVector CameFromCenter = Octree.GetNodeCenter(CameFrom);
+
+				//Added before the center, so it ends up after it once the path is flipped.
+				//Not needed in an any-angle path, every part of it was checked for line of sight.
+				if (!Settings.AnyAngle && Octree.GetNodeHalfSize(Previous) != Octree.GetNodeHalfSize(CameFrom))
+				{
+					OutPathList.Add(DirectionTowardsSharedFaceFromSmallerNode(Octree.GetNodeCenter(Previous), Octree.GetNodeHalfSize(Previous),
+					                                                          CameFromCenter, Octree.GetNodeHalfSize(CameFrom)));
+				}
+
+				OutPathList.Add(CameFromCenter);
+
+				Previous = CameFrom;
+				CameFrom = Scratch.CameFrom[CameFrom];
+			}
+
+			Algo::Reverse(OutPathList.GetData() + FirstNewPoint, OutPathList.Num() - FirstNewPoint);
+		}
+
+		if (Resume && Settings.AnyAngle)
+		{
+			const FVector FirstPoint = OutPathList.Num() > FirstNewPoint ? OutPathList[FirstNewPoint] : TargetLocation;
+			if (!Octree.HasLineOfSight(StartLocation, FirstPoint, Settings.AgentRadius))
+			{
+				OutPathList.SetNum(FirstNewPoint, EAllowShrinking::No);
+				return false;
+			}
+
+			const FVector LastPoint = OutPathList.Num() > FirstNewPoint ? OutPathList.Last() : StartLocation;
+			if (TargetWasExpanded && !Octree.HasLineOfSight(LastPoint, TargetLocation, Settings.AgentRadius))
+			{
+				OutPathList.Add(Octree.GetNodeCenter(Target));
+			}
+		}
+
+		OutPathList.Add(TargetLocation);
+
+		if (Debug && Target == End && Scratch.Weight < Settings.HeuristicWeight)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Path improved with heuristic weight %f."), Scratch.Weight);
+		}
+		else if (Debug && Target == End)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Path found in avg. in %f seconds"), AddTimeTaken(FPlatformTime::Seconds() - StartTime));
+		}
+		else if (Debug)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Out of search budget, returning a partial path of %i points."), OutPathList.Num() - FirstNewPoint);
+		}
+
+		return true;
+	};
+
+	auto StartOver = [&]()
+	{
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Resumed path is blocked at the start, searching again."));
+		Scratch.HasTree = false;
+		OutPathList.SetNum(FirstPathPoint, EAllowShrinking::No);
+		return FindLinearOctreePath(ThreadIsPaused, Debug, Octree, Corridor, Scratch, StartLocation, EndLocation, OutPathList, Settings);
+	};
+
+	//Outdated copies get the same F as the real entry, they are still skipped once it is closed.
+	auto RekeyOpen = [&]()
+	{
+		for (FLinearOctreeSearchScratch::FOpenEntry& Entry : Scratch.OpenHeap)
+		{
+			Entry.F = Scratch.G[Entry.Node] + Distance(GetPosition(Entry.Node), EndPosition) * Scratch.Weight;
+		}
+
+		Scratch.OpenHeap.Heapify();
+	};
+
+	//ARA*, same as in LazyOctreeAStar.
+	auto LowerWeight = [&]()
+	{
+		Scratch.Weight = FMath::Max(Settings.FinalHeuristicWeight, Scratch.Weight - Settings.HeuristicWeightStep);
+		Scratch.OpenHeap.Add({0, End});
+		for (const uint32 Cell : Scratch.Inconsistent)
+		{
+			Scratch.OpenHeap.Add({0, Cell});
+		}
+
+		Scratch.Inconsistent.Reset();
+		Scratch.BeginIteration();
+		RekeyOpen();
+	};
+
+	//Same as in LazyOctreeAStar, the parents between the new start and the old one are flipped, then every G is measured again.
+	if (Reroot)
+	{
+		uint32 Child = LinearOctree::InvalidIndex;
+		for (uint32 Cell = Start; Cell != LinearOctree::InvalidIndex;)
+		{
+			const uint32 Parent = Scratch.CameFrom[Cell];
+			Scratch.CameFrom[Cell] = Child;
+			Child = Cell;
+			Cell = Parent;
+		}
+
+		for (uint32 Cell = 0; Cell < static_cast<uint32>(Octree.NumCells()); Cell++)
+		{
+			if (Scratch.OpenStamp[Cell] == Stamp) Scratch.G[Cell] = -1;
+		}
+
+		Scratch.G[Start] = 0;
+
+		for (uint32 Cell = 0; Cell < static_cast<uint32>(Octree.NumCells()); Cell++)
+		{
+			if (Scratch.OpenStamp[Cell] != Stamp || Scratch.G[Cell] >= 0) continue;
+
+			Scratch.Chain.Reset();
+			uint32 Measured = Cell;
+			for (; Measured != LinearOctree::InvalidIndex && Scratch.G[Measured] < 0; Measured = Scratch.CameFrom[Measured])
+			{
+				Scratch.Chain.Add(Measured);
+			}
+
+			for (int32 ChainIndex = Scratch.Chain.Num() - 1; ChainIndex >= 0; ChainIndex--)
+			{
+				const uint32 ChainCell = Scratch.Chain[ChainIndex];
+				Scratch.G[ChainCell] = Measured == LinearOctree::InvalidIndex ? 0 : Scratch.G[Measured] + Distance(GetPosition(Measured), GetPosition(ChainCell));
+				Measured = ChainCell;
+			}
+		}
+
+		Scratch.TreeStart = Start;
+		if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start moved within the kept tree, rerooted it."));
+	}
+
+	if (Resume)
+	{
+		//The previous end was popped without being expanded, it goes back to the open cells. Unless it was occupied, then nothing leads there.
+		if (PreviousEnd != LinearOctree::InvalidIndex && Scratch.OpenStamp[PreviousEnd] == Stamp && !Scratch.WasExpanded(PreviousEnd) &&
+			(!Octree.IsOccupied(PreviousEnd) || PreviousEnd == End))
+		{
+			//It was measured to the old end location.
+			const uint32 Parent = Scratch.CameFrom[PreviousEnd];
+			if (Parent != LinearOctree::InvalidIndex)
+			{
+				Scratch.G[PreviousEnd] = Scratch.G[Parent] + Distance(GetPosition(Parent), GetPosition(PreviousEnd));
+			}
+
+			Scratch.OpenHeap.Add({0, PreviousEnd});
+		}
+
+		//Every G is a distance from the start, only the heuristic changed.
+		RekeyOpen();
+
+		if (Scratch.WasExpanded(End))
+		{
+			return FinishPath(End, true) || StartOver();
+		}
+
+		//An occupied end is only offered to the cells expanded from now on, the expanded ones next to it get a second look.
+		if (Scratch.OpenStamp[End] != Stamp)
+		{
+			for (const uint32 Neighbor : EndNeighbors)
+			{
+				if (!Scratch.WasExpanded(Neighbor)) continue;
+
+				const uint32 From = Settings.AnyAngle && Scratch.CameFrom[Neighbor] != LinearOctree::InvalidIndex ? Scratch.CameFrom[Neighbor] : Neighbor;
+				const float TentativeG = Scratch.G[From] + Distance(GetPosition(From), EndPosition);
+				if (Scratch.OpenStamp[End] == Stamp && Scratch.G[End] <= TentativeG) continue;
+
+				Scratch.OpenStamp[End] = Stamp;
+				Scratch.G[End] = TentativeG;
+				Scratch.CameFrom[End] = From;
+				Scratch.OpenHeap.HeapPush({TentativeG, End});
+			}
+		}
+	}
+	else
+	{
+		Scratch.G[Start] = 0;
+		Scratch.CameFrom[Start] = LinearOctree::InvalidIndex;
+		Scratch.OpenStamp[Start] = Stamp;
+		Scratch.OpenHeap.HeapPush({Distance(GetPosition(Start), EndPosition) * Scratch.Weight, Start});
+
+		Scratch.HasTree = Settings.Incremental && Corridor == nullptr;
+		Scratch.TreeStart = Start;
+	}
+
+	const double PathfindingTimer = FPlatformTime::Seconds();
+
+	//Closest to the end of the cells expanded by this call, for a partial path.
+	uint32 Closest = LinearOctree::InvalidIndex;
+	float ClosestDistance = FLT_MAX;
+	int32 Expansions = 0;
+
+	//Same as in LazyOctreeAStar.
+	bool Improving = false;
+	float HandedOutG = FLT_MAX;
+
+	auto HasBudget = [&]()
+	{
+		return (Settings.ExpansionBudget <= 0 || Expansions < Settings.ExpansionBudget) &&
+			FPlatformTime::Seconds() - PathfindingTimer <= Settings.TimeBudget;
+	};
+
+	while (!Scratch.OpenHeap.IsEmpty() && !ThreadIsPaused && HasBudget())
+	{
+		FLinearOctreeSearchScratch::FOpenEntry Entry;
+		Scratch.OpenHeap.HeapPop(Entry);
+		const uint32 Current = Entry.Node;
+
+		//The heap can hold outdated copies of a node that got a better G later on.
+		if (Scratch.IsClosed(Current)) continue;
+		Expansions++;
+
+		const FVector CurrentPosition = GetPosition(Current);
+		Scratch.Neighbors.Reset();
+		Octree.GetNeighbors(Current, Scratch.Neighbors);
+
+		//Lazy Theta* only checks the line of sight once a node is expanded. If it is blocked, the node falls back to the best
+		//expanded neighbor as its parent, which is what plain A* would have picked.
+		const uint32 Parent = Scratch.CameFrom[Current];
+		if (Settings.AnyAngle && Parent != LinearOctree::InvalidIndex && !Octree.HasLineOfSight(GetPosition(Parent), CurrentPosition, Settings.AgentRadius))
+		{
+			uint32 BestNeighbor = LinearOctree::InvalidIndex;
+			float BestG = FLT_MAX;
+			for (const uint32 Neighbor : Scratch.Neighbors)
+			{
+				if (!Scratch.WasExpanded(Neighbor)) continue;
+
+				const float G = Scratch.G[Neighbor] + Distance(GetPosition(Neighbor), CurrentPosition);
+				if (G < BestG)
+				{
+					BestNeighbor = Neighbor;
+					BestG = G;
+				}
+			}
+
+			//The cell that reached this one is always among them, neighbors are symmetric.
+			if (BestNeighbor != LinearOctree::InvalidIndex)
+			{
+				Scratch.CameFrom[Current] = BestNeighbor;
+				Scratch.G[Current] = BestG;
+			}
+		}
+
+		if (Current == End)
+		{
+			OutPathList.SetNum(FirstPathPoint, EAllowShrinking::No);
+			if (!FinishPath(End, false))
+			{
+				return StartOver();
+			}
+
+			//Same as in LazyOctreeAStar, the path goes back right away and the next incremental query improves it, or this one.
+			if (Settings.Anytime && Scratch.Weight > Settings.FinalHeuristicWeight)
+			{
+				LowerWeight();
+
+				if (Settings.OnPathImproved && HasBudget())
+				{
+					if (Scratch.G[End] < HandedOutG)
+					{
+						HandedOutG = Scratch.G[End];
+						Settings.OnPathImproved(TConstArrayView<FVector>(OutPathList.GetData() + FirstPathPoint, OutPathList.Num() - FirstPathPoint));
+					}
+
+					Improving = true;
+					continue;
+				}
+			}
+
+			return true;
+		}
+
+		Scratch.ClosedStamp[Current] = Scratch.CloseStamp;
+
+		const float DistanceToEnd = Distance(CurrentPosition, EndPosition);
+		if (Current != Start && DistanceToEnd < ClosestDistance)
+		{
+			Closest = Current;
+			ClosestDistance = DistanceToEnd;
+		}
+
+		if (!EndNeighbors.IsEmpty() && EndNeighbors.Contains(Current))
+		{
+			Scratch.Neighbors.Add(End);
+		}
+
+		//In an any-angle search the neighbors are first offered the parent of the current node, the line of sight is checked later.
+		const uint32 From = Settings.AnyAngle && Scratch.CameFrom[Current] != LinearOctree::InvalidIndex ? Scratch.CameFrom[Current] : Current;
+		const FVector FromPosition = GetPosition(From);
+
+		for (const uint32 Neighbor : Scratch.Neighbors)
+		{
+			if (!Settings.Anytime && Scratch.IsClosed(Neighbor)) continue;
+			if (Corridor != nullptr && Scratch.CorridorStamp[Corridor->GetCluster(Neighbor)] != Scratch.CoarseStamp) continue;
+
+			const FVector NeighborPosition = GetPosition(Neighbor);
+			const float TentativeG = Scratch.G[From] + Distance(FromPosition, NeighborPosition);
+
+			if (Scratch.OpenStamp[Neighbor] == Stamp && Scratch.G[Neighbor] <= TentativeG) continue;
 
-	TSharedPtr<OctreeNode> Start = RootNode->LazyDivideAndFindNode(ThreadIsPaused, ActorBoxes, MinSize, StartLocation, false);
-	TSharedPtr<OctreeNode> End = RootNode->LazyDivideAndFindNode(ThreadIsPaused, ActorBoxes, MinSize, EndLocation, false);
+			Scratch.OpenStamp[Neighbor] = Stamp;
+			Scratch.G[Neighbor] = TentativeG;
+			Scratch.CameFrom[Neighbor] = From;
 
+			//ARA*: a closed cell that got cheaper is expanded again with the next weight.
+			if (Scratch.IsClosed(Neighbor))
+			{
+				Scratch.Inconsistent.Add(Neighbor);
+				continue;
+			}
+
+			Scratch.OpenHeap.HeapPush({TentativeG + Distance(NeighborPosition, EndPosition) * Scratch.Weight, Neighbor});
+		}
+	}
+
+	//Same as in LazyOctreeAStar, out of budget while improving an anytime path still returns the last one.
+	if (Settings.Anytime && (Resume || Improving) && !ThreadIsPaused && Scratch.OpenStamp[End] == Stamp)
+	{
+		OutPathList.SetNum(FirstPathPoint, EAllowShrinking::No);
+		return FinishPath(End, false) || StartOver();
+	}
+
+	//Out of budget. The open cells are still there for the next call to carry on with, the agent gets as close as the search got.
+	if (!Scratch.OpenHeap.IsEmpty() && !ThreadIsPaused && Closest != LinearOctree::InvalidIndex)
+	{
+		return FinishPath(Closest, false) || StartOver();
+	}
+
+	if (Debug) UE_LOG(LogTemp, Error, TEXT("Couldn't find path"));
+	return false;
+}
+
+bool OctreeGraph::GetNeighbors(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, OctreeNode* CurrentNode,
+                               const FOctreeBoxIndex& ActorBoxes, const float& MinSize, TArray<OctreeNode*>& FaceLeaves)
+{
+	//Cleaning up the neighbors list from stale handles.
+	TSet<FOctreeNodeHandle>& Neighbors = CurrentNode->PathfindingData->Neighbors;
+
+	bool HasStaleNeighbors = false;
+	for (const FOctreeNodeHandle& Neighbor : Neighbors)
+	{
+		HasStaleNeighbors |= !Neighbor.IsValid();
+	}
+
+	if (HasStaleNeighbors)
+	{
+		CurrentNode->PathfindingData->NeighborsComplete = false;
+
+		for (auto It = Neighbors.CreateIterator(); It; ++It)
+		{
+			//!Occupied is explained at the bottom of LazyDivideAndFindNode() in OctreeNode.cpp.
+			if (!It->IsValid() || It->Node->Occupied)
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	if (CurrentNode->PathfindingData->NeighborsComplete)
+	{
+		return !Neighbors.IsEmpty();
+	}
+
+	//Only the first time, or after something around the node was freed. The links make that one descent per face plus a walk over the neighbors.
+	FaceLeaves.Reset();
+	for (int Face = 0; Face < 6; Face++)
+	{
+		if (ThreadIsPaused) return false;
+
+		FOctreeNodeHandle& FaceLink = CurrentNode->PathfindingData->FaceLinks[Face];
+		OctreeNode* Link = FaceLink.Get();
+		if (Link == nullptr)
+		{
+			Link = FindFaceNeighbor(Arena, CurrentNode, Face, ActorBoxes, MinSize);
+			FaceLink = Link;
+		}
+
+		if (Link != nullptr)
+		{
+			GatherFaceLeaves(Arena, Link, Face, ActorBoxes, MinSize, FaceLeaves);
+		}
+	}
+
+	for (OctreeNode* Node : FaceLeaves)
+	{
+		if (Neighbors.Contains(Node)) continue;
+
+		Neighbors.Add(Node);
+		Arena.GetOrAddPathfindingData(*Node).Neighbors.Add(CurrentNode);
+	}
+
+	CurrentNode->PathfindingData->NeighborsComplete = true;
+	return !Neighbors.IsEmpty();
+}
+
+void OctreeGraph::FindNearestFreeLeaves(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, const FOctreeBoxIndex& ActorBoxes,
+                                        const float& MinSize, const FVector& Location, const float MaxRadius, const int32 Count, TArray<OctreeNode*>& OutLeaves)
+{
+	struct FEntry
+	{
+		double DistanceSquared;
+		OctreeNode* Node;
+		//The root's children and the expand volumes are never classified, they are always divided once they are looked at.
+		bool IsRootChild;
+
+		bool operator<(const FEntry& Other) const { return DistanceSquared < Other.DistanceSquared; }
+	};
+
+	TArray<FEntry, TInlineAllocator<64>> Heap;
+	const double MaxDistanceSquared = FMath::Square(static_cast<double>(MaxRadius));
+
+	auto Push = [&](OctreeNode& Node, const bool IsRootChild)
+	{
+		//Nothing free in there, and it cannot be divided into anything free either.
+		if (!IsRootChild && !Node.HasChildren() && Node.Occupied && !Node.IsDivisible) return;
+
+		const double DistanceSquared = FBox::BuildAABB(Node.Position, FVector(Node.HalfSize)).ComputeSquaredDistanceToPoint(Location);
+		if (DistanceSquared <= MaxDistanceSquared)
+		{
+			Heap.HeapPush({DistanceSquared, &Node, IsRootChild});
+		}
+	};
+
+	//Same as in LazyDivideAndFindNode(), the root is divided the first time it is used.
+	OctreeNode* RootNode = Arena.GetRoot();
+	if (!RootNode->HasChildren())
+	{
+		Arena.Divide(*RootNode);
+		RootNode->Occupied = true;
+	}
+
+	for (OctreeNode& Child : RootNode->GetChildren())
+	{
+		Push(Child, true);
+	}
 
-	if (Start == nullptr || End == nullptr)
+	const int32 FirstLeaf = OutLeaves.Num();
+	while (!Heap.IsEmpty() && OutLeaves.Num() - FirstLeaf < Count && !ThreadIsPaused)
 	{
-		/*
-		if (Start == nullptr)
-		{
-			Start = PreviousValidStart.Pin();
-		}
-		else PreviousValidStart = Start.ToWeakPtr();
+		FEntry Entry;
+		Heap.HeapPop(Entry, EAllowShrinking::No);
+		OctreeNode* Node = Entry.Node;
 
-		if (End == nullptr)
+		if (!Node->HasChildren())
 		{
-			End = PreviousValidEnd.Pin();
+			if (!Node->Occupied && !Entry.IsRootChild)
+			{
+				OutLeaves.Add(Node);
+				continue;
+			}
+
+			//Only partly occupied, the free part of it is in its children. Same as in LazyDivideAndFindNode() for the root's children.
+			Node->DivideAndClassify(Arena, ActorBoxes, MinSize);
 		}
-		else PreviousValidEnd = End.ToWeakPtr();
-		*/
 
-		if (Start == nullptr || End == nullptr)
+		for (OctreeNode& Child : Node->GetChildren())
 		{
-			if (Debug) UE_LOG(LogTemp, Warning, TEXT("Start or End is out of bounds."));
-			return false;
+			Push(Child, false);
 		}
 	}
+}
 
-	float PathfindingTimer = FPlatformTime::Seconds();
-	Start->PathfindingData = MakeShareable(new FPathfindingNode());
-	End->PathfindingData = MakeShareable(new FPathfindingNode());
+bool OctreeGraph::MayBeConnected(const FLinearOctree& Octree, const uint32 Start, const uint32 End, TArray<uint32>& Neighbors)
+{
+	if (!Octree.HasComponents())
+	{
+		return true;
+	}
 
-	//In case we are using an occupied node as an end, we force finding neighbors here,
-	//As the start will get their neighbor called anyway due to how Current Node works
-	//But the End will never be neighbor of any if it is occupied.
-	//Hence, forcing it here to have neighbors.
-	if (End->Occupied)
+	auto GatherComponents = [&](const uint32 Cell, TArray<uint32, TInlineAllocator<8>>& OutComponents)
 	{
-		if (!GetNeighbors(ThreadIsPaused, RootNode, End, ActorBoxes, MinSize))
+		if (!Octree.IsOccupied(Cell))
 		{
-			if (Debug) UE_LOG(LogTemp, Warning, TEXT("End node is inaccessible."));
-			return false; //End node is inaccessible.
+			OutComponents.Add(Octree.GetComponent(Cell));
+			return;
 		}
-	}
 
-	std::priority_queue<TSharedPtr<OctreeNode>, std::vector<TSharedPtr<OctreeNode>>, FPathfindingNodeCompare> OpenQueue;
-	TSet<TSharedPtr<OctreeNode>> OpenSet; //I use it to keep track of all the nodes used to reset them and also check which ones I checked before.
-	TSet<TSharedPtr<OctreeNode>> ClosedSet;
+		Neighbors.Reset();
+		Octree.GetNeighbors(Cell, Neighbors);
+		for (const uint32 Neighbor : Neighbors)
+		{
+			OutComponents.AddUnique(Octree.GetComponent(Neighbor));
+		}
+	};
 
-	Start->PathfindingData->G = 0;
-	Start->PathfindingData->H = ManhattanDistance(Start, End) * ExtraHWeight;
-	Start->PathfindingData->F = Start->PathfindingData->H;
+	TArray<uint32, TInlineAllocator<8>> StartComponents;
+	TArray<uint32, TInlineAllocator<8>> EndComponents;
+	GatherComponents(Start, StartComponents);
+	GatherComponents(End, EndComponents);
 
-	OpenQueue.push(Start);
-	OpenSet.Add(Start);
+	for (const uint32 Component : StartComponents)
+	{
+		if (EndComponents.Contains(Component)) return true;
+	}
 
-	PathfindingMemoryTick++;
+	return false;
+}
 
-	while (!OpenQueue.empty() && !ThreadIsPaused && FPlatformTime::Seconds() - PathfindingTimer <= MaxPathfindingTime)
+bool OctreeGraph::IsKnownUnreachable(const FOctreeNodeArena& Arena, OctreeNode* Start, OctreeNode* End)
+{
+	if (Arena.FloodedRevision != Arena.Revision)
 	{
-		TSharedPtr<OctreeNode> CurrentNode = OpenQueue.top();
-
-		if (CurrentNode == nullptr) return false;
+		return false;
+	}
 
-		if (CurrentNode == End)
-		{
-			ReconstructPath(Start, End, OutPathList);
-			OutPathList.Add(EndLocation);
+	for (const FOctreeNodeArena::FFloodedComponent& Component : Arena.FloodedComponents)
+	{
+		if (!Component.Leaves.Contains(Start)) continue;
 
-			for (const auto& Node : OpenSet)
-			{
-				if (Node.IsValid())
-				{
-					Node->PathfindingData->G = FLT_MAX;
-					Node->PathfindingData->H = FLT_MAX;
-					Node->PathfindingData->F = FLT_MAX;
-					Node->PathfindingData->CameFrom.Reset();
-				}
-			}
+		//The flood went through every free leaf next to the component, dividing the occupied ones on the way. A free leaf that is not
+		//in it is in another one.
+		return End->Occupied ? Component.End == FOctreeNodeHandle(End) : !Component.Leaves.Contains(End);
+	}
 
-			ClosedSet.Empty();
+	return false;
+}
 
-			if (PathfindingMemoryTick > MemoryCleanupFrequency)
-			{
-				//Given I use root node thousands of times, making it a non const reference is not a good idea.
-				//So I will just loop through its children to clean up
-				//Because I might reset the pointer of the passed node, I cant pass in a const reference to CleanupUnusedNodes.
-				//The reason I do it for grandchild, is because I should not reset the children of the root node.
-				//Because, if we don't use auto encapsulation, we have 'custom' first children, which cannot be remade via MakeChild().
-				int DeletedChildren = 0;
-				for (const auto& Child : RootNode->ChildrenOctreeNodes)
-				{
-					for (auto& GrandChild : Child->ChildrenOctreeNodes)
-					{
-						if (GrandChild.IsValid()) CleanupUnusedNodes(GrandChild, OpenSet, DeletedChildren);
-					}
-				}
-				PathfindingMemoryTick = 0;
-				if (Debug) UE_LOG(LogTemp, Warning, TEXT("Octree memory cleanup. Deleted %i nodes."), DeletedChildren);
-			}
+void OctreeGraph::RememberFloodedComponent(FOctreeNodeArena& Arena, const FLazyOctreeSearchContext& Context, OctreeNode* End)
+{
+	int32 LeafCount = 0;
+	for (const FLazyOctreeSearchContext::FSearchRecord& Record : Context.Records)
+	{
+		LeafCount += Record.VisitedStamp == Context.Stamp;
+	}
 
+	if (LeafCount > FOctreeNodeArena::MaxFloodedLeaves)
+	{
+		return;
+	}
 
-			if (Debug)
-			{
-				TimeTaken.Add(FPlatformTime::Seconds() - StartTime);
+	FScopeLock DivideScope(&Arena.DivideLock);
 
-				float Total = 0;
-				for (const auto Time : TimeTaken)
-				{
-					Total += Time;
-				}
+	if (Arena.FloodedRevision != Arena.Revision)
+	{
+		Arena.FloodedComponents.Reset();
+		Arena.FloodedRevision = Arena.Revision;
+	}
 
-				UE_LOG(LogTemp, Warning, TEXT("Path found in avg. in %f seconds"), Total / (float)TimeTaken.Num());
-			}
+	//Oldest out first. A chase rarely has more than a couple of places it cannot get to at once.
+	if (Arena.FloodedComponents.Num() >= FOctreeNodeArena::MaxFloodedComponents)
+	{
+		Arena.FloodedComponents.RemoveAt(0);
+	}
 
+	FOctreeNodeArena::FFloodedComponent& Component = Arena.FloodedComponents.AddDefaulted_GetRef();
+	Component.End = End;
+	Component.Leaves.Reserve(LeafCount);
 
-			return true;
+	for (const FLazyOctreeSearchContext::FSearchRecord& Record : Context.Records)
+	{
+		if (Record.VisitedStamp == Context.Stamp)
+		{
+			Component.Leaves.Add(FOctreeNodeHandle(Record.Node));
 		}
+	}
+}
 
-		CurrentNode->MemoryOptimizerTick++;
-		OpenQueue.pop();
-		ClosedSet.Add(CurrentNode);
-
-		//Return false there are no neighbors. 
-		if (!GetNeighbors(ThreadIsPaused, RootNode, CurrentNode, ActorBoxes, MinSize)) continue;
+bool OctreeGraph::SnapToFreeCell(const FLinearOctree& Octree, const uint32 Cell, const FVector& Location, const float Radius, FVector& OutLocation)
+{
+	if (Radius <= 0 || (Cell != LinearOctree::InvalidIndex && !Octree.IsOccupied(Cell)))
+	{
+		return false;
+	}
 
+	TArray<uint32> Nearest;
+	Octree.FindNearestFreeCells(Location, Radius, 1, Nearest);
+	if (Nearest.IsEmpty())
+	{
+		return false;
+	}
 
-		for (const auto& NeighborWeakPtr : CurrentNode->PathfindingData->Neighbors)
-		{
-			if (ThreadIsPaused) return false;
+	OutLocation = SnapIntoLeaf(Octree.GetNodeBox(Nearest[0]), Location);
+	return true;
+}
 
-			TSharedPtr<OctreeNode> NeighborPtr = NeighborWeakPtr.Pin();
+FVector OctreeGraph::SnapIntoLeaf(const FBox& LeafBox, const FVector& Location)
+{
+	return LeafBox.ExpandBy(-LeafBox.GetExtent().GetMin() * 0.1).GetClosestPointTo(Location);
+}
 
-			if (!NeighborPtr.IsValid() || ClosedSet.Contains(NeighborPtr)) continue;
+OctreeNode* OctreeGraph::FindFaceNeighbor(FOctreeNodeArena& Arena, const OctreeNode* Node, const int Face, const FOctreeBoxIndex& ActorBoxes,
+                                          const float& MinSize)
+{
+	//Just across the face, in the middle of it. Any node of at least our size on the other side contains it.
+	const FVector Probe = Node->Position + FVector(DIRECTIONS[Face]) * Node->HalfSize * 1.01f;
+	OctreeNode* Current = Arena.GetRoot();
 
-			const TSharedPtr<FPathfindingNode>& NeighborData = NeighborPtr->PathfindingData;
+	if (!Current->IsInsideNode(Probe))
+	{
+		return nullptr;
+	}
 
-			const float TentativeG = CurrentNode->PathfindingData->G + ManhattanDistance(CurrentNode, NeighborPtr);
+	for (int Depth = 0; ; Depth++)
+	{
+		//The children of the root are always divided when they are used, see LazyDivideAndFindNode().
+		if (Depth == 1 && !Current->HasChildren())
+		{
+			Current->DivideAndClassify(Arena, ActorBoxes, MinSize);
+		}
 
-			if (NeighborData->G <= TentativeG) continue;
+		//Sizes halve exactly, so anything not bigger than 1.5 times ours is the same size.
+		if (Current->HalfSize <= Node->HalfSize * 1.5f)
+		{
+			return Current;
+		}
 
-			NeighborData->G = TentativeG;
-			NeighborData->H = ManhattanDistance(NeighborPtr, End) * ExtraHWeight; // Can do weighted to increase performance
-			NeighborData->F = NeighborData->G + NeighborData->H;
+		if (!Current->HasChildren())
+		{
+			//A bigger leaf, it is the neighbor of the whole face.
+			if (!Current->Occupied || !Current->IsDivisible) return Current;
 
-			NeighborData->CameFrom = CurrentNode.ToWeakPtr();
+			Current->DivideAndClassify(Arena, ActorBoxes, MinSize);
+		}
 
-			if (!OpenSet.Contains(NeighborPtr))
+		OctreeNode* Next = nullptr;
+		for (OctreeNode& Child : Current->GetChildren())
+		{
+			if (Child.IsInsideNode(Probe))
 			{
-				OpenSet.Add(NeighborPtr);
-				OpenQueue.push(NeighborPtr);
+				Next = &Child;
 			}
 		}
-	}
-	for (const auto& Node : OpenSet)
-	{
-		if (Node.IsValid())
+
+		//Only possible in the padding of the root, outside the expand volumes.
+		if (Next == nullptr)
 		{
-			Node->PathfindingData->G = FLT_MAX;
-			Node->PathfindingData->H = FLT_MAX;
-			Node->PathfindingData->F = FLT_MAX;
-			Node->PathfindingData->CameFrom.Reset();
+			return nullptr;
 		}
-	}
 
-	if (Debug) UE_LOG(LogTemp, Error, TEXT("Couldn't find path"));
-	return false;
+		Current = Next;
+	}
 }
 
-bool OctreeGraph::GetNeighbors(const bool& ThreadIsPaused, const TSharedPtr<OctreeNode>& RootNode, const TSharedPtr<OctreeNode>& CurrentNode,
-                               const TArray<FBox>& ActorBoxes, const float& MinSize)
+void OctreeGraph::GatherFaceLeaves(FOctreeNodeArena& Arena, OctreeNode* Node, const int Face, const FOctreeBoxIndex& ActorBoxes, const float& MinSize,
+                                   TArray<OctreeNode*>& OutLeaves)
 {
-	//Cleaning up the neighbors list from invalid pointers.
-	TSet<TWeakPtr<OctreeNode>>& Neighbors = CurrentNode->PathfindingData->Neighbors;
-
-	if (Neighbors.Contains(nullptr))
+	if (!Node->HasChildren())
 	{
-		TSet<TWeakPtr<OctreeNode>> ValidNeighbors;
-		for (const auto& Neighbor : Neighbors)
+		if (!Node->Occupied)
 		{
-			//!Occupied is explained at the bottom of LazyDivideAndFindNode() in OctreeNode.cpp.
-			if (Neighbor.IsValid() && !Neighbor.Pin()->Occupied)
-			{
-				ValidNeighbors.Add(Neighbor);
-			}
+			OutLeaves.Add(Node);
+			return;
 		}
-		Neighbors = ValidNeighbors;
-	}
 
-	int NeighborCount = 0;
-	TArray<TArray<FVector>> PotentialNeighborPositions;
-	for (int i = 0; i < 6; i++)
-	{
-		PotentialNeighborPositions.Add(CalculatePositions(CurrentNode, i, MinSize));
-		NeighborCount += PotentialNeighborPositions[i].Num();
-	}
+		if (!Node->IsDivisible) return;
 
-	//If we already have all the neighbors, no need to continue. Else, we still made useful calculation for the neighbors.
-	if (Neighbors.Num() == NeighborCount)
-	{
-		return true;
+		Node->DivideAndClassify(Arena, ActorBoxes, MinSize);
 	}
 
-	for (int i = 0; i < 6; i++)
+	//The face is seen from the other side, so it is the children on the opposite side of the direction that touch it.
+	const int Axis = Face / 2;
+	const int Direction = DIRECTIONS[Face][Axis];
+
+	for (OctreeNode& Child : Node->GetChildren())
 	{
-		for (const auto& Pos : PotentialNeighborPositions[i])
+		if ((Child.Position[Axis] - Node->Position[Axis]) * Direction < 0)
 		{
-			if (ThreadIsPaused) return false;
-
-			const TSharedPtr<OctreeNode> Node = RootNode->LazyDivideAndFindNode(ThreadIsPaused, ActorBoxes, MinSize, Pos, true);
-			if (Node.IsValid() && !Neighbors.Contains(Node.ToWeakPtr()))
-			{
-				Neighbors.Add(Node.ToWeakPtr());
-				if (!Node->PathfindingData.IsValid())
-				{
-					Node->PathfindingData = MakeShareable(new FPathfindingNode());
-				}
-				Node->PathfindingData->Neighbors.Add(CurrentNode.ToWeakPtr());
-			}
+			GatherFaceLeaves(Arena, &Child, Face, ActorBoxes, MinSize, OutLeaves);
 		}
 	}
-
-	return !Neighbors.IsEmpty();
 }
 
 
-void OctreeGraph::ReconstructPath(const TSharedPtr<OctreeNode>& Start, const TSharedPtr<OctreeNode>& End,
+void OctreeGraph::ReconstructPath(const FLazyOctreeSearchContext& Context, const int32 StartIndex, const int32 EndIndex, const bool AddBufferPoints,
                                   TArray<FVector>& OutPathList)
 {
 	/* Because I am using Center position as the target in pathfinding, adding those to the list might not ensure a smooth path.
@@ -288,47 +1614,60 @@ void OctreeGraph::ReconstructPath(const TSharedPtr<OctreeNode>& Start, const TSh
 	 * However, the physics based smoothing is done in Octree
 	 */
 
-	if (Start == End)
+	if (StartIndex == EndIndex)
 	{
 		return;
 	}
 
-	//I am not checking validity because it must be valid. If not, I know where to look, but it should be impossible to be invalid.
-	TSharedPtr<OctreeNode> CameFrom = End->PathfindingData->CameFrom.Pin();
-	TSharedPtr<OctreeNode> Previous = End;
+	//Walking back from the end, then flipping it, instead of inserting at the front every time.
+	const int32 FirstNewPoint = OutPathList.Num();
+	const OctreeNode* Previous = Context.Records[EndIndex].Node;
+	int32 CameFromIndex = Context.Records[EndIndex].CameFrom;
 
-	while (CameFrom != nullptr && CameFrom != Start)
+	while (CameFromIndex != INDEX_NONE && CameFromIndex != StartIndex)
 	{
-		if (Previous->HalfSize != CameFrom->HalfSize)
+		const OctreeNode* CameFrom = Context.Records[CameFromIndex].Node;
+
+		//Added before the center, so it ends up after it once the path is flipped.
+		if (AddBufferPoints && Previous->HalfSize != CameFrom->HalfSize)
 		{
 			const FVector BufferVector = DirectionTowardsSharedFaceFromSmallerNode(Previous, CameFrom);
-			OutPathList.Insert(BufferVector, 0);
+			OutPathList.Add(BufferVector);
 		}
 
-		OutPathList.Insert(CameFrom->Position, 0);
+		OutPathList.Add(CameFrom->Position);
+
 		Previous = CameFrom;
-		CameFrom = CameFrom->PathfindingData->CameFrom.Pin();
+		CameFromIndex = Context.Records[CameFromIndex].CameFrom;
 	}
+
+	Algo::Reverse(OutPathList.GetData() + FirstNewPoint, OutPathList.Num() - FirstNewPoint);
 }
 
 
-FVector OctreeGraph::DirectionTowardsSharedFaceFromSmallerNode(const TSharedPtr<OctreeNode>& Node1, const TSharedPtr<OctreeNode>& Node2)
+FVector OctreeGraph::DirectionTowardsSharedFaceFromSmallerNode(const OctreeNode* Node1, const OctreeNode* Node2)
+{
+	return DirectionTowardsSharedFaceFromSmallerNode(Node1->Position, Node1->HalfSize, Node2->Position, Node2->HalfSize);
+}
+
+FVector OctreeGraph::DirectionTowardsSharedFaceFromSmallerNode(const FVector& Center1, const float HalfSize1, const FVector& Center2,
+                                                               const float HalfSize2)
 {
 	float SmallSize = 1;
 	FVector SmallerCenter;
 	FVector LargerCenter;
 
-	if (Node1->HalfSize < Node2->HalfSize)
+	if (HalfSize1 < HalfSize2)
 	{
-		SmallSize = Node1->HalfSize;
-		SmallerCenter = Node1->Position;
-		LargerCenter = Node2->Position;
+		SmallSize = HalfSize1;
+		SmallerCenter = Center1;
+		LargerCenter = Center2;
 	}
-	else if (Node2->HalfSize < Node1->HalfSize)
+	else if (HalfSize2 < HalfSize1)
 	{
-		SmallSize = Node2->HalfSize;
-		SmallerCenter = Node2->Position;
-		LargerCenter = Node1->Position;
+		SmallSize = HalfSize2;
+		SmallerCenter = Center2;
+		LargerCenter = Center1;
 	}
 
 	// Calculate the difference vector between the centers of the two boxes
@@ -356,107 +1695,343 @@ FVector OctreeGraph::DirectionTowardsSharedFaceFromSmallerNode(const TSharedPtr<
 	return SmallerCenter + Direction * SmallSize;
 }
 
-
-float OctreeGraph::ManhattanDistance(const TSharedPtr<OctreeNode>& From, const TSharedPtr<OctreeNode>& To)
+FBox OctreeGraph::GetPortal(const FBox& From, const FBox& To, const float Radius)
 {
-	//Standard Manhattan dist calculation.
-	const FVector Point1 = From->Position;
-	const FVector Point2 = To->Position;
+	FBox Portal(From.Min.ComponentMax(To.Min), From.Max.ComponentMin(To.Max));
 
-	const float Dx = FMath::Abs(Point2.X - Point1.X);
-	const float Dy = FMath::Abs(Point2.Y - Point1.Y);
-	const float Dz = FMath::Abs(Point2.Z - Point1.Z);
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		const double Extent = Portal.Max[Axis] - Portal.Min[Axis];
 
-	return Dx + Dy + Dz;
+		//The axis the face is flat on.
+		if (Extent <= KINDA_SMALL_NUMBER) continue;
+
+		//A face narrower than the agent leaves only its middle line, the agent squeezes through the center.
+		const double Shrink = FMath::Min(static_cast<double>(Radius), Extent * 0.5);
+		Portal.Min[Axis] += Shrink;
+		Portal.Max[Axis] -= Shrink;
+	}
+
+	return Portal;
 }
 
-TArray<FVector> OctreeGraph::CalculatePositions(const TSharedPtr<OctreeNode>& CurrentNode, const int& Face, const float& MinNodeSize)
+void OctreeGraph::PullString(const FVector& Start, const FVector& End, const TArray<FBox>& Portals, TArray<FVector>& Points,
+                             TArray<FVector>& OutPathList)
 {
-	TArray<FVector> PotentialNeighborPositions;
+	/* The cells are convex, so the shortest path through them is made of straight lines between one point on every face they share.
+	 * Finding those points is a convex problem, so moving one point at a time to its best spot between its two neighbors gets there.
+	 * The best spot on a face is where the line between the neighbors crosses its plane (mirrored through it if both are on the same side),
+	 * clamped to the face. Passes go back and forth, so a change travels along the whole path within a couple of them.
+	 */
+	constexpr int32 MaxPasses = 32;
+	//Squared, in units. Below that nothing moves anymore that the agent would notice.
+	constexpr double Tolerance = 1.0;
+
+	const int32 Count = Portals.Num();
+	if (Count == 0) return;
 
-	// Calculate the start position of the face
-	const FVector StartPosition = CurrentNode->Position + FVector(DIRECTIONS[Face]) * CurrentNode->HalfSize * 1.01f;
+	Points.Reset();
+	for (const FBox& Portal : Portals)
+	{
+		Points.Add(Portal.GetCenter());
+	}
 
-	// Calculate the number of steps in each direction
-	const int Steps = FMath::RoundToInt(CurrentNode->HalfSize * 2.0f / MinNodeSize);
-	//Because if it is 1.9999 due to float error, it would be rounded to 1 by default.
+	auto FlatAxis = [](const FBox& Portal)
+	{
+		const FVector Extent = Portal.Max - Portal.Min;
+		return Extent.X <= Extent.Y && Extent.X <= Extent.Z ? 0 : Extent.Y <= Extent.Z ? 1 : 2;
+	};
 
-	FVector Axis1, Axis2;
-	if (DIRECTIONS[Face] == FIntVector(1, 0, 0) || DIRECTIONS[Face] == FIntVector(-1, 0, 0))
+	for (int32 Pass = 0; Pass < MaxPasses; Pass++)
 	{
-		Axis1 = FVector(0, 1, 0);
-		Axis2 = FVector(0, 0, 1);
+		double LargestMove = 0;
+		const bool Forward = Pass % 2 == 0;
+
+		for (int32 Step = 0; Step < Count; Step++)
+		{
+			const int32 Index = Forward ? Step : Count - 1 - Step;
+			const FVector& Previous = Index == 0 ? Start : Points[Index - 1];
+			const FVector& Next = Index == Count - 1 ? End : Points[Index + 1];
+			const FBox& Portal = Portals[Index];
+
+			const int Axis = FlatAxis(Portal);
+			const double Plane = Portal.Min[Axis];
+
+			FVector Target = Next;
+			if ((Previous[Axis] - Plane) * (Next[Axis] - Plane) > 0)
+			{
+				Target[Axis] = 2 * Plane - Next[Axis];
+			}
+
+			const double Delta = Target[Axis] - Previous[Axis];
+			const double Alpha = FMath::Abs(Delta) > KINDA_SMALL_NUMBER ? (Plane - Previous[Axis]) / Delta : 0.5;
+			const FVector Point = Portal.GetClosestPointTo(FMath::Lerp(Previous, Target, Alpha));
+
+			LargestMove = FMath::Max(LargestMove, FVector::DistSquared(Point, Points[Index]));
+			Points[Index] = Point;
+		}
+
+		if (LargestMove < Tolerance) break;
 	}
-	else if (DIRECTIONS[Face] == FIntVector(0, 1, 0) || DIRECTIONS[Face] == FIntVector(0, -1, 0))
+
+	//Points the path goes straight through are dropped. Dropping several in a row is fine, they are all on the same line.
+	for (int32 Index = 0; Index < Count; Index++)
 	{
-		Axis1 = FVector(1, 0, 0);
-		Axis2 = FVector(0, 0, 1);
+		const FVector& Previous = Index == 0 ? Start : Points[Index - 1];
+		const FVector& Next = Index == Count - 1 ? End : Points[Index + 1];
+
+		if (FMath::PointDistToSegmentSquared(Points[Index], Previous, Next) > Tolerance)
+		{
+			OutPathList.Add(Points[Index]);
+		}
 	}
-	else //if (DIRECTIONS[Face].Equals(FVector(0, 0, 1)) || DIRECTIONS[Face].Equals(FVector(0, 0, -1)))
+}
+
+
+void FLinearOctreeSearchScratch::BeginSearch()
+{
+	if (++Stamp == 0)
 	{
-		Axis1 = FVector(1, 0, 0);
-		Axis2 = FVector(0, 1, 0);
+		FMemory::Memzero(OpenStamp.GetData(), OpenStamp.Num() * sizeof(uint32));
+		FMemory::Memzero(ClosedStamp.GetData(), ClosedStamp.Num() * sizeof(uint32));
+		Stamp = 1;
+		CloseStamp = 0;
 	}
 
-	if (Steps == 1) //Meaning it is a minimum-sized node.
+	OpenHeap.Reset();
+	Inconsistent.Reset();
+	BeginIteration();
+	TreeCloseStamp = CloseStamp;
+}
+
+void FLinearOctreeSearchScratch::BeginIteration()
+{
+	if (++CloseStamp == 0)
 	{
-		PotentialNeighborPositions.Add(StartPosition);
-		return PotentialNeighborPositions;
+		FMemory::Memzero(ClosedStamp.GetData(), ClosedStamp.Num() * sizeof(uint32));
+		CloseStamp = 1;
+		TreeCloseStamp = 1;
 	}
+}
+
+int32 FLazyOctreeSearchContext::GetRecordIndex(const OctreeNode* Node)
+{
+	const int32 Slot = Node->PathfindingData->Slot;
 
-	// Iterate over the face in steps of the size of the minimum node
-	for (int i = -Steps / 2; i <= Steps / 2; i++) //Because of the octree structure, steps will always be a multiple of 2. Int is safe.
+	if (Slot >= Records.Num())
 	{
-		if (i == 0) continue;
+		//Zeroed stamps never match, the stamp starts at 1.
+		Records.SetNumZeroed(Align(Slot + 1, RecordGrowth));
+	}
 
-		for (int j = -Steps / 2; j <= Steps / 2; j++)
-		{
-			if (j == 0) continue;
+	return Slot;
+}
 
-			// Calculate the position
-			const FVector PotentialNeighborPosition = StartPosition + Axis1 * i * MinNodeSize + Axis2 * j * MinNodeSize;
+bool FLazyOctreeSearchContext::WasReached(const OctreeNode* Node) const
+{
+	if (Node->PathfindingData == nullptr || !Records.IsValidIndex(Node->PathfindingData->Slot)) return false;
 
-			// Add the position to the list
-			PotentialNeighborPositions.Add(PotentialNeighborPosition);
-		}
+	//The slot might have been handed to another node since.
+	const FSearchRecord& Record = Records[Node->PathfindingData->Slot];
+	return Record.VisitedStamp == Stamp && Record.Node == Node;
+}
+
+void FLazyOctreeSearchContext::BeginSearch()
+{
+	if (++Stamp == 0)
+	{
+		FMemory::Memzero(Records.GetData(), Records.Num() * sizeof(FSearchRecord));
+		Stamp = 1;
+		CloseStamp = 0;
 	}
 
-	return PotentialNeighborPositions;
+	OpenHeap.Reset();
+	Inconsistent.Reset();
+	BeginIteration();
+	TreeCloseStamp = CloseStamp;
 }
 
-void OctreeGraph::CleanupUnusedNodes(TSharedPtr<OctreeNode>& Node, const TSet<TSharedPtr<OctreeNode>>& OpenSet, int& DeletedChildrenCount)
+void FLazyOctreeSearchContext::BeginIteration()
 {
-	for (auto& Child : Node->ChildrenOctreeNodes)
+	if (++CloseStamp == 0)
 	{
-		if (!Child.IsValid()) continue;
-
-		if (!Child->ChildrenOctreeNodes.IsEmpty())
+		//Only forgets which nodes the tree expanded in earlier weights, which Lazy Theta* can do without.
+		for (FSearchRecord& Record : Records)
 		{
-			CleanupUnusedNodes(Child, OpenSet, DeletedChildrenCount);
-			continue;
+			Record.ClosedStamp = 0;
 		}
 
+		CloseStamp = 1;
+		TreeCloseStamp = 1;
+	}
+}
 
-		//We want to keep the nodes that were just used in case they were just created.
-		if (Child->MemoryOptimizerTick < MemoryOptimizerTickThreshold && !OpenSet.Contains(Child))
-		{
-			Child.Reset();
-			DeletedChildrenCount++;
-		}
-		else
+void FLazyOctreeSearchContext::OpenInconsistent()
+{
+	for (const int32 RecordIndex : Inconsistent)
+	{
+		Records[RecordIndex].HeapIndex = OpenHeap.Add(RecordIndex);
+	}
+
+	Inconsistent.Reset();
+}
+
+void FLazyOctreeSearchContext::HeapPush(const int32 RecordIndex)
+{
+	Records[RecordIndex].HeapIndex = OpenHeap.Add(RecordIndex);
+	SiftUp(Records[RecordIndex].HeapIndex);
+}
+
+int32 FLazyOctreeSearchContext::HeapPop()
+{
+	const int32 Top = OpenHeap[0];
+	Records[Top].HeapIndex = INDEX_NONE;
+
+	const int32 Last = OpenHeap.Pop(EAllowShrinking::No);
+	if (!OpenHeap.IsEmpty())
+	{
+		OpenHeap[0] = Last;
+		Records[Last].HeapIndex = 0;
+		SiftDown(0);
+	}
+
+	return Top;
+}
+
+void FLazyOctreeSearchContext::HeapDecreaseKey(const int32 RecordIndex)
+{
+	//A record that was already popped is not re-opened, same as the closed check in the search.
+	if (Records[RecordIndex].HeapIndex < 0) return;
+
+	SiftUp(Records[RecordIndex].HeapIndex);
+}
+
+void FLazyOctreeSearchContext::Heapify()
+{
+	if (OpenHeap.Num() < 2) return;
+
+	//Bottom up from the last parent, every subtree below it is already a heap.
+	for (int32 Index = (OpenHeap.Num() - 2) / HeapArity; Index >= 0; Index--)
+	{
+		SiftDown(Index);
+	}
+}
+
+void FLazyOctreeSearchContext::SiftUp(int32 Index)
+{
+	const int32 RecordIndex = OpenHeap[Index];
+	const float F = Records[RecordIndex].F;
+
+	while (Index > 0)
+	{
+		const int32 Parent = (Index - 1) / HeapArity;
+		if (Records[OpenHeap[Parent]].F <= F) break;
+
+		OpenHeap[Index] = OpenHeap[Parent];
+		Records[OpenHeap[Index]].HeapIndex = Index;
+		Index = Parent;
+	}
+
+	OpenHeap[Index] = RecordIndex;
+	Records[RecordIndex].HeapIndex = Index;
+}
+
+void FLazyOctreeSearchContext::SiftDown(int32 Index)
+{
+	const int32 RecordIndex = OpenHeap[Index];
+	const float F = Records[RecordIndex].F;
+	const int32 Num = OpenHeap.Num();
+
+	while (true)
+	{
+		const int32 FirstChild = Index * HeapArity + 1;
+		if (FirstChild >= Num) break;
+
+		//Smallest of up to 4 children, which sit next to each other in the array.
+		int32 Best = FirstChild;
+		float BestF = Records[OpenHeap[FirstChild]].F;
+		const int32 LastChild = FMath::Min(FirstChild + HeapArity, Num);
+		for (int32 Child = FirstChild + 1; Child < LastChild; Child++)
 		{
-			Child->MemoryOptimizerTick = 0;
-			Node->NodeIsInUse = true;
-			if (Child->PathfindingData.IsValid())
+			const float ChildF = Records[OpenHeap[Child]].F;
+			if (ChildF < BestF)
 			{
-				for (auto& Neighbor : Child->PathfindingData->Neighbors)
-				{
-					if (Neighbor.IsValid() && !Neighbor.Pin()->Occupied) continue;
-					Neighbor.Reset(); //Resetting the neighbor if it is occupied.
-				}
+				Best = Child;
+				BestF = ChildF;
 			}
 		}
+
+		if (F <= BestF) break;
+
+		OpenHeap[Index] = OpenHeap[Best];
+		Records[OpenHeap[Index]].HeapIndex = Index;
+		Index = Best;
+	}
+
+	OpenHeap[Index] = RecordIndex;
+	Records[RecordIndex].HeapIndex = Index;
+}
+
+float OctreeGraph::ManhattanDistance(const OctreeNode* From, const OctreeNode* To)
+{
+	//Standard Manhattan dist calculation.
+	const FVector Point1 = From->Position;
+	const FVector Point2 = To->Position;
+
+	const float Dx = FMath::Abs(Point2.X - Point1.X);
+	const float Dy = FMath::Abs(Point2.Y - Point1.Y);
+	const float Dz = FMath::Abs(Point2.Z - Point1.Z);
+
+	return Dx + Dy + Dz;
+}
+
+void OctreeGraph::ReclassifyLeaves(OctreeNode& Node, const FBox& Region, const FOctreeBoxIndex& ActorBoxes, const float& MinSize,
+                                   TArray<OctreeNode*>& OutChanged)
+{
+	const FBox NodeBox = FBox::BuildAABB(Node.Position, FVector(Node.HalfSize));
+	if (!NodeBox.Intersect(Region))
+	{
+		return;
+	}
+
+	if (Node.HasChildren())
+	{
+		for (OctreeNode& Child : Node.GetChildren())
+		{
+			ReclassifyLeaves(Child, Region, ActorBoxes, MinSize, OutChanged);
+		}
+		return;
+	}
+
+	const FOctreeBoxIndex::EOverlap Overlap = ActorBoxes.Classify(NodeBox);
+	const bool Occupied = Overlap != FOctreeBoxIndex::EOverlap::None;
+	//+1 to avoid float error, same as DivideAndClassify(). Free leaves keep the default.
+	const bool IsDivisible = !Occupied || (Overlap != FOctreeBoxIndex::EOverlap::Inside && Node.HalfSize * 2 > MinSize + 1);
+
+	if (Occupied == Node.Occupied && IsDivisible == Node.IsDivisible)
+	{
+		return;
+	}
+
+	Node.Occupied = Occupied;
+	Node.IsDivisible = IsDivisible;
+	OutChanged.Add(&Node);
+}
+
+void OctreeGraph::InvalidateNeighbors(OctreeNode& Node, const FBox& Region)
+{
+	if (!FBox::BuildAABB(Node.Position, FVector(Node.HalfSize)).Intersect(Region))
+	{
+		return;
+	}
+
+	if (Node.PathfindingData != nullptr)
+	{
+		Node.PathfindingData->NeighborsComplete = false;
 	}
 
-	if (!Node->NodeIsInUse) Node.Reset();
+	for (OctreeNode& Child : Node.GetChildren())
+	{
+		InvalidateNeighbors(Child, Region);
+	}
 }
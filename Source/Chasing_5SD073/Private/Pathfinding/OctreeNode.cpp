@@ -1,30 +1,24 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "Pathfinding/OctreeNode.h"
+#include "Pathfinding/OctreeNodeArena.h"
 
 LLM_DEFINE_TAG(OctreeNode);
 
 OctreeNode::OctreeNode(const FVector& Pos, const float HalfSize)
 {
-	LLM_SCOPE_BYTAG(OctreeNode);
 	Position = Pos;
 	this->HalfSize = HalfSize;
 }
 
 OctreeNode::OctreeNode()
 {
-	LLM_SCOPE_BYTAG(OctreeNode);
 	Position = FVector::ZeroVector;
 	HalfSize = 0;
 }
 
-OctreeNode::~OctreeNode()
-{
-	PathfindingData.Reset();
-}
-
-TSharedPtr<OctreeNode> OctreeNode::LazyDivideAndFindNode(const bool& ThreadIsPaused, const TArray<FBox>& ActorBoxes, const float& MinSize,
-                                                         const FVector& Location, const bool LookingForNeighbor)
+OctreeNode* OctreeNode::LazyDivideAndFindNode(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, const FOctreeBoxIndex& ActorBoxes,
+                                              const float& MinSize, const FVector& Location, const bool LookingForNeighbor)
 {
 	if (!IsInsideNode(Location))
 	{
@@ -32,84 +26,41 @@ TSharedPtr<OctreeNode> OctreeNode::LazyDivideAndFindNode(const bool& ThreadIsPau
 	}
 
 
-	TSharedPtr<OctreeNode> ToReturn;
-	TSharedPtr<OctreeNode> InsideNode;
+	OctreeNode* ToReturn = nullptr;
+	OctreeNode* InsideNode = nullptr;
 
-	if (ChildrenOctreeNodes.IsEmpty())
+	if (!HasChildren())
 	{
-		ChildrenOctreeNodes.SetNum(8);
-		for (int i = 0; i < 8; i++)
-		{
-			ChildrenOctreeNodes[i] = MakeChild(i);
-		}
+		Arena.Divide(*this);
 		Occupied = true;
 	}
 
-	if (!ChildrenOctreeNodes.IsEmpty())
+	for (OctreeNode& Child : GetChildren())
 	{
-		for (const auto& Child : ChildrenOctreeNodes)
+		if (Child.IsInsideNode(Location))
 		{
-			if (Child->IsInsideNode(Location))
-			{
-				ToReturn = Child;
-				break; //It cannot be in multiple children at once.
-			}
+			ToReturn = &Child;
+			break; //It cannot be in multiple children at once.
 		}
 	}
 
 	//This code assumes that the children of root node are divisible and not completely inside an object.
 	//If auto encapsulate is on, this should never be the case.
 	//Otherwise it will return nullptr.
-	while (ToReturn.IsValid() && !ThreadIsPaused)
+	while (ToReturn != nullptr && !ThreadIsPaused)
 	{
-		if (ToReturn->ChildrenOctreeNodes.IsEmpty())
+		if (!ToReturn->HasChildren())
 		{
-			ToReturn->ChildrenOctreeNodes.SetNum(8);
+			ToReturn->DivideAndClassify(Arena, ActorBoxes, MinSize);
 		}
 
-		for (int j = 0; j < 8; j++)
+		for (OctreeNode& Child : ToReturn->GetChildren())
 		{
-			if (ThreadIsPaused) return nullptr;
-
-			if (!ToReturn->ChildrenOctreeNodes[j].IsValid())
+			if (Child.IsInsideNode(Location))
 			{
-				ToReturn->ChildrenOctreeNodes[j] = ToReturn->MakeChild(j);
-				const FVector Center = ToReturn->ChildrenOctreeNodes[j]->Position;
-				const FVector Offset = FVector(ToReturn->ChildrenOctreeNodes[j]->HalfSize);
-				const FBox NodeBox = FBox(Center - Offset, Center + Offset);
-
-
-				for (const auto& Box : ActorBoxes)
-				{
-					if (NodeBox.Intersect(Box))
-					{
-						ToReturn->Occupied = true;
-						ToReturn->ChildrenOctreeNodes[j]->IsDivisible = ToReturn->ChildrenOctreeNodes[j]->HalfSize * 2 > MinSize + 1;
-						//+1 to avoid float error
-						ToReturn->ChildrenOctreeNodes[j]->Occupied = true;
-						break;
-					}
-				}
-
-
-				if (ToReturn->ChildrenOctreeNodes[j]->Occupied && ToReturn->ChildrenOctreeNodes[j]->IsDivisible)
-				{
-					for (const auto& Box : ActorBoxes)
-					{
-						if (Box.IsInside(NodeBox))
-						{
-							ToReturn->ChildrenOctreeNodes[j]->IsDivisible = false;
-							break;
-						}
-					}
-				}
-			}
-
-			if (ToReturn->ChildrenOctreeNodes[j]->IsInsideNode(Location))
-			{
-				InsideNode = ToReturn->ChildrenOctreeNodes[j];
+				InsideNode = &Child;
 				//Not breaking on purpose because I need the other children to check if they are closer to the location.
-				//Because I am not breaking, I can't do ToReturn = ToReturn->ChildrenOctreeNodes[j]; here.
+				//Because I am not breaking, I can't do ToReturn = &Child; here.
 			}
 		}
 
@@ -131,23 +82,23 @@ TSharedPtr<OctreeNode> OctreeNode::LazyDivideAndFindNode(const bool& ThreadIsPau
 			return nullptr;
 		}
 
-		TSharedPtr<OctreeNode> ClosestUnoccupied;
-		for (const auto& Child : ToReturn->ChildrenOctreeNodes)
+		OctreeNode* ClosestUnoccupied = nullptr;
+		for (OctreeNode& Child : ToReturn->GetChildren())
 		{
-			if (Child->Occupied) continue;
+			if (Child.Occupied) continue;
 
-			if (!ClosestUnoccupied.IsValid()) ClosestUnoccupied = Child;
+			if (ClosestUnoccupied == nullptr) ClosestUnoccupied = &Child;
 
-			if (FVector::DistSquared(Child->Position, Location) <= FVector::DistSquared(ClosestUnoccupied->Position, Location))
+			if (FVector::DistSquared(Child.Position, Location) <= FVector::DistSquared(ClosestUnoccupied->Position, Location))
 			{
-				ClosestUnoccupied = Child;
+				ClosestUnoccupied = &Child;
 			}
 		}
 
 
 		//ToReturn = ClosestUnoccupied;		
 
-		if (ClosestUnoccupied.IsValid())
+		if (ClosestUnoccupied != nullptr)
 		{
 			ToReturn = ClosestUnoccupied;
 		}
@@ -180,59 +131,58 @@ TSharedPtr<OctreeNode> OctreeNode::LazyDivideAndFindNode(const bool& ThreadIsPau
 	return nullptr;
 }
 
-TSharedPtr<OctreeNode> OctreeNode::MakeChild(const int& ChildIndex) const
+void OctreeNode::MakeChild(const int& ChildIndex, OctreeNode& OutChild) const
 {
 	const float ChildHalfSize = HalfSize / 2.0f;
 	const FVector SizeVec = FVector(ChildHalfSize);
 
 	switch (ChildIndex)
 	{
-	case 0: return MakeShareable(new OctreeNode(Position - SizeVec, ChildHalfSize));
-	case 1: return MakeShareable(new OctreeNode(FVector(Position.X + SizeVec.X, Position.Y - SizeVec.Y, Position.Z - SizeVec.Z),
-	                                            ChildHalfSize));
-	case 2: return MakeShareable(new OctreeNode(FVector(Position.X + SizeVec.X, Position.Y + SizeVec.Y, Position.Z - SizeVec.Z),
-	                                            ChildHalfSize));
-	case 3: return MakeShareable(new OctreeNode(FVector(Position.X - SizeVec.X, Position.Y + SizeVec.Y, Position.Z - SizeVec.Z),
-	                                            ChildHalfSize));
-
-	case 4: return MakeShareable(new OctreeNode(FVector(Position.X - SizeVec.X, Position.Y - SizeVec.Y, Position.Z + SizeVec.Z),
-	                                            ChildHalfSize));
-	case 5: return MakeShareable(new OctreeNode(FVector(Position.X + SizeVec.X, Position.Y - SizeVec.Y, Position.Z + SizeVec.Z),
-	                                            ChildHalfSize));
-	case 6: return MakeShareable(new OctreeNode(Position + SizeVec, ChildHalfSize));
-	case 7: return MakeShareable(new OctreeNode(FVector(Position.X - SizeVec.X, Position.Y + SizeVec.Y, Position.Z + SizeVec.Z),
-	                                            ChildHalfSize));
-	default: return nullptr;
+	case 0: OutChild.Position = Position - SizeVec; break;
+	case 1: OutChild.Position = FVector(Position.X + SizeVec.X, Position.Y - SizeVec.Y, Position.Z - SizeVec.Z); break;
+	case 2: OutChild.Position = FVector(Position.X + SizeVec.X, Position.Y + SizeVec.Y, Position.Z - SizeVec.Z); break;
+	case 3: OutChild.Position = FVector(Position.X - SizeVec.X, Position.Y + SizeVec.Y, Position.Z - SizeVec.Z); break;
+
+	case 4: OutChild.Position = FVector(Position.X - SizeVec.X, Position.Y - SizeVec.Y, Position.Z + SizeVec.Z); break;
+	case 5: OutChild.Position = FVector(Position.X + SizeVec.X, Position.Y - SizeVec.Y, Position.Z + SizeVec.Z); break;
+	case 6: OutChild.Position = Position + SizeVec; break;
+	case 7: OutChild.Position = FVector(Position.X - SizeVec.X, Position.Y + SizeVec.Y, Position.Z + SizeVec.Z); break;
+	default: return;
 	}
-}
-
-bool OctreeNode::IsInsideNode(const FVector& Location) const
-{
-	const FVector MinPoint = Position - HalfSize;
-	const FVector MaxPoint = Position + HalfSize;
 
-	return (Location.X >= MinPoint.X && Location.X <= MaxPoint.X) &&
-		(Location.Y >= MinPoint.Y && Location.Y <= MaxPoint.Y) &&
-		(Location.Z >= MinPoint.Z && Location.Z <= MaxPoint.Z);
+	//Only the placement, the rest was reset by the arena and the generation has to stay.
+	OutChild.HalfSize = ChildHalfSize;
 }
 
-void OctreeNode::DeleteOctreeNode(TSharedPtr<OctreeNode>& Node)
+void OctreeNode::DivideAndClassify(FOctreeNodeArena& Arena, const FOctreeBoxIndex& ActorBoxes, const float& MinSize)
 {
-	// Traverse the octree from the root node to the leaf nodes
-	for (TSharedPtr<OctreeNode>& Child : Node->ChildrenOctreeNodes)
+	//The arena hands out all 8 children at once, so they are all classified right away.
+	Arena.Divide(*this);
+
+	for (OctreeNode& Child : GetChildren())
 	{
-		if (Child != nullptr)
+		const FVector Offset = FVector(Child.HalfSize);
+		const FBox NodeBox = FBox(Child.Position - Offset, Child.Position + Offset);
+
+		//One pass over the boxes around the node answers both if it is occupied and if it is completely inside something.
+		const FOctreeBoxIndex::EOverlap Overlap = ActorBoxes.Classify(NodeBox);
+
+		if (Overlap != FOctreeBoxIndex::EOverlap::None)
 		{
-			// Recursively delete child nodes
-			DeleteOctreeNode(Child);
+			Occupied = true;
+			//+1 to avoid float error
+			Child.IsDivisible = Overlap != FOctreeBoxIndex::EOverlap::Inside && Child.HalfSize * 2 > MinSize + 1;
+			Child.Occupied = true;
 		}
 	}
+}
 
-	//Is this redundant? Do I need to check for validity?
-	if (Node->PathfindingData.IsValid())
-	{
-		Node->PathfindingData.Reset();
-	}
+bool OctreeNode::IsInsideNode(const FVector& Location) const
+{
+	const FVector MinPoint = Position - HalfSize;
+	const FVector MaxPoint = Position + HalfSize;
 
-	Node.Reset();
+	return (Location.X >= MinPoint.X && Location.X <= MaxPoint.X) &&
+		(Location.Y >= MinPoint.Y && Location.Y <= MaxPoint.Y) &&
+		(Location.Z >= MinPoint.Z && Location.Z <= MaxPoint.Z);
 }
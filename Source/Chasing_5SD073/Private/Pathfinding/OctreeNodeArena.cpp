@@ -0,0 +1,358 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/OctreeNodeArena.h"
+
+FOctreeNodeArena::FOctreeNodeArena(const FVector& RootPosition, const float RootHalfSize) : Root(RootPosition, RootHalfSize)
+{
+}
+
+FOctreeNodeArena::~FOctreeNodeArena()
+{
+	//No need to walk the tree, every node and search data lives in one of these.
+	for (const FBrood* Slab : BroodSlabs)
+	{
+		delete[] Slab;
+	}
+
+	for (const FPathfindingNode* Slab : PathfindingDataSlabs)
+	{
+		delete[] Slab;
+	}
+}
+
+int32 FOctreeNodeArena::EnterEpoch(const uint64 Epoch)
+{
+	while (true)
+	{
+		for (int32 Reader = 0; Reader < MaxReaders; Reader++)
+		{
+			uint64 FreeSlot = 0;
+			if (ReaderEpochs[Reader].compare_exchange_strong(FreeSlot, Epoch))
+			{
+				return Reader;
+			}
+		}
+
+		FPlatformProcess::Yield();
+	}
+}
+
+uint64 FOctreeNodeArena::GetOldestEpoch() const
+{
+	//A search that is still entering its epoch has not got any node yet, it needs DivideLock for that.
+	uint64 Oldest = MAX_uint64;
+	for (const std::atomic<uint64>& ReaderEpoch : ReaderEpochs)
+	{
+		const uint64 Epoch = ReaderEpoch;
+		if (Epoch != 0) Oldest = FMath::Min(Oldest, Epoch);
+	}
+
+	return Oldest;
+}
+
+bool FOctreeNodeArena::GetLeafBroodEpoch(const OctreeNode& Node, uint64& OutEpoch)
+{
+	if (!Node.HasChildren())
+	{
+		return false;
+	}
+
+	OutEpoch = 0;
+	for (const OctreeNode& Child : Node.GetChildren())
+	{
+		if (Child.HasChildren()) return false;
+		OutEpoch = FMath::Max(OutEpoch, Child.LastEpoch);
+	}
+
+	return true;
+}
+
+void FOctreeNodeArena::ForgetFloodedComponents(OctreeNode& Parent)
+{
+	if (FloodedComponents.IsEmpty())
+	{
+		return;
+	}
+
+	for (OctreeNode& Child : Parent.GetChildren())
+	{
+		const FOctreeNodeHandle Handle(&Child);
+		FloodedComponents.RemoveAll([&Handle](const FFloodedComponent& Component) { return Component.Leaves.Contains(Handle); });
+	}
+}
+
+int32 FOctreeNodeArena::EvictOverBudget()
+{
+	if (MemoryBudget == 0 || GetUsedSize() <= MemoryBudget)
+	{
+		return 0;
+	}
+
+	const double EndTime = FPlatformTime::Seconds() + EvictionTimeBudget;
+	const uint64 OldestEpoch = GetOldestEpoch();
+	int32 EvictedCount = 0;
+	int32 Steps = 0;
+	bool Rescanned = false;
+
+	while (GetUsedSize() > MemoryBudget)
+	{
+		//A step only looks at a few nodes, the clock is not worth reading for every one of them.
+		if (++Steps % 16 == 0 && FPlatformTime::Seconds() > EndTime)
+		{
+			break;
+		}
+
+		//The walk finishes before anything is evicted, so the candidates are in least recently used order across the whole tree.
+		if (!EvictionScan.IsEmpty())
+		{
+			const FOctreeNodeHandle Handle = EvictionScan.Pop(EAllowShrinking::No);
+			const OctreeNode* Node = Handle.Get();
+			if (Node == nullptr) continue;
+
+			uint64 Epoch;
+			if (GetLeafBroodEpoch(*Node, Epoch))
+			{
+				EvictionCandidates.HeapPush({Handle, Epoch});
+				continue;
+			}
+
+			for (OctreeNode& Child : Node->GetChildren())
+			{
+				if (Child.HasChildren()) EvictionScan.Add(&Child);
+			}
+			continue;
+		}
+
+		if (EvictionCandidates.IsEmpty())
+		{
+			//Nothing left to evict since the last walk.
+			if (Rescanned) break;
+			Rescanned = true;
+
+			//Starting below the root's children, which are never freed. The expand volumes cannot be made again.
+			for (const OctreeNode& Child : Root.GetChildren())
+			{
+				for (OctreeNode& GrandChild : Child.GetChildren())
+				{
+					if (GrandChild.HasChildren()) EvictionScan.Add(&GrandChild);
+				}
+			}
+			continue;
+		}
+
+		FEvictionCandidate Candidate;
+		EvictionCandidates.HeapPop(Candidate, EAllowShrinking::No);
+
+		//Freed or divided further since the walk, the next walk finds what it is now.
+		OctreeNode* Parent = Candidate.Parent.Get();
+		uint64 Epoch;
+		if (Parent == nullptr || !GetLeafBroodEpoch(*Parent, Epoch)) continue;
+
+		//Used again since the walk, it goes back in line.
+		if (Epoch > Candidate.Epoch)
+		{
+			EvictionCandidates.HeapPush({Candidate.Parent, Epoch});
+			continue;
+		}
+
+		//The least recently used brood is held by a running search. The others were used even later.
+		if (Epoch >= OldestEpoch)
+		{
+			EvictionCandidates.HeapPush(Candidate);
+			break;
+		}
+
+		EvictedEpoch = FMath::Max(EvictedEpoch.load(), Epoch);
+		EvictedCount += Parent->ChildCount;
+		ForgetFloodedComponents(*Parent);
+		FreeChildren(*Parent);
+	}
+
+	return EvictedCount;
+}
+
+void FOctreeNodeArena::AddBroodSlab()
+{
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	FBrood* Slab = new FBrood[BroodsPerSlab];
+	BroodSlabs.Add(Slab);
+
+	//Handed out back to front, so the slab gets used front to back.
+	FreeBroods.Reserve(FreeBroods.Num() + BroodsPerSlab);
+	for (int32 i = BroodsPerSlab - 1; i >= 0; i--)
+	{
+		FreeBroods.Add(&Slab[i]);
+	}
+}
+
+void FOctreeNodeArena::AddPathfindingDataSlab()
+{
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	FPathfindingNode* Slab = new FPathfindingNode[PathfindingDataPerSlab];
+	const int32 FirstSlot = PathfindingDataSlabs.Add(Slab) * PathfindingDataPerSlab;
+
+	FreePathfindingData.Reserve(FreePathfindingData.Num() + PathfindingDataPerSlab);
+	for (int32 i = PathfindingDataPerSlab - 1; i >= 0; i--)
+	{
+		Slab[i].Slot = FirstSlot + i;
+		FreePathfindingData.Add(&Slab[i]);
+	}
+}
+
+void FOctreeNodeArena::Divide(OctreeNode& Node)
+{
+	check(!Node.HasChildren());
+
+	if (FreeBroods.IsEmpty())
+	{
+		AddBroodSlab();
+	}
+
+	FBrood* Brood = FreeBroods.Pop(EAllowShrinking::No);
+
+	for (int i = 0; i < 8; i++)
+	{
+		Node.MakeChild(i, Brood->Nodes[i]);
+	}
+
+	Node.Children = Brood->Nodes;
+	Node.ChildCount = 8;
+	LiveNodeCount += 8;
+}
+
+TArrayView<OctreeNode> FOctreeNodeArena::DivideCustom(OctreeNode& Node, const int32 Count)
+{
+	check(!Node.HasChildren());
+
+	LLM_SCOPE_BYTAG(OctreeNode);
+
+	TArray<OctreeNode>& Block = CustomBlocks.AddDefaulted_GetRef();
+	Block.SetNum(Count);
+
+	Node.Children = Block.GetData();
+	Node.ChildCount = Count;
+	LiveNodeCount += Count;
+
+	return Node.GetChildren();
+}
+
+bool FOctreeNodeArena::IsCustomBlock(const OctreeNode* Children) const
+{
+	for (const TArray<OctreeNode>& Block : CustomBlocks)
+	{
+		if (Block.GetData() == Children) return true;
+	}
+
+	return false;
+}
+
+void FOctreeNodeArena::FreeChildren(OctreeNode& Node)
+{
+	if (!Node.HasChildren())
+	{
+		return;
+	}
+
+	//The expand volumes cannot be remade by MakeChild(), so a custom block stays attached and only loses what is below it.
+	const bool IsCustom = IsCustomBlock(Node.Children);
+
+	for (OctreeNode& Child : Node.GetChildren())
+	{
+		FreeChildren(Child);
+		FreePathfindingData(Child);
+
+		if (IsCustom) continue;
+
+		//Reset to a fresh node, but keep counting generations so handles to the old one stay invalid.
+		const uint32 NextGeneration = Child.Generation + 1;
+		Child = OctreeNode();
+		Child.Generation = NextGeneration;
+	}
+
+	if (IsCustom)
+	{
+		return;
+	}
+
+	FreeBroods.Add(reinterpret_cast<FBrood*>(Node.Children));
+	LiveNodeCount -= Node.ChildCount;
+	Node.Children = nullptr;
+	Node.ChildCount = 0;
+}
+
+void FOctreeNodeArena::RecycleNode(OctreeNode& Node)
+{
+	FreePathfindingData(Node);
+	Node.Generation++;
+}
+
+FPathfindingNode& FOctreeNodeArena::GetOrAddPathfindingData(OctreeNode& Node)
+{
+	if (Node.PathfindingData == nullptr)
+	{
+		if (FreePathfindingData.IsEmpty())
+		{
+			AddPathfindingDataSlab();
+		}
+
+		Node.PathfindingData = FreePathfindingData.Pop(EAllowShrinking::No);
+		LivePathfindingDataCount++;
+	}
+
+	return *Node.PathfindingData;
+}
+
+void FOctreeNodeArena::FreePathfindingData(OctreeNode& Node)
+{
+	if (Node.PathfindingData == nullptr)
+	{
+		return;
+	}
+
+	FPathfindingNode& Data = *Node.PathfindingData;
+	for (FOctreeNodeHandle& Link : Data.FaceLinks)
+	{
+		Link.Reset();
+	}
+	Data.NeighborsComplete = false;
+	//Reset() keeps the set's memory, the next node that gets this data will likely need about as many neighbors.
+	Data.Neighbors.Reset();
+
+	FreePathfindingData.Add(Node.PathfindingData);
+	Node.PathfindingData = nullptr;
+	LivePathfindingDataCount--;
+}
+
+SIZE_T FOctreeNodeArena::GetUsedSize() const
+{
+	SIZE_T Size = LiveNodeCount * sizeof(OctreeNode) + LivePathfindingDataCount * sizeof(FPathfindingNode);
+	for (const FFloodedComponent& Component : FloodedComponents)
+	{
+		Size += Component.Leaves.GetAllocatedSize();
+	}
+
+	return Size;
+}
+
+SIZE_T FOctreeNodeArena::GetAllocatedSize() const
+{
+	SIZE_T Size = BroodSlabs.Num() * BroodsPerSlab * sizeof(FBrood) + FreeBroods.GetAllocatedSize() + BroodSlabs.GetAllocatedSize();
+	Size += PathfindingDataSlabs.Num() * PathfindingDataPerSlab * sizeof(FPathfindingNode) + FreePathfindingData.GetAllocatedSize() +
+		PathfindingDataSlabs.GetAllocatedSize();
+
+	for (const TArray<OctreeNode>& Block : CustomBlocks)
+	{
+		Size += Block.GetAllocatedSize();
+	}
+
+	Size += EvictionCandidates.GetAllocatedSize() + EvictionScan.GetAllocatedSize() + FloodedComponents.GetAllocatedSize();
+	for (const FFloodedComponent& Component : FloodedComponents)
+	{
+		Size += Component.Leaves.GetAllocatedSize();
+	}
+
+	//Not counting what the neighbor sets allocate on their own.
+	return Size + CustomBlocks.GetAllocatedSize();
+}
@@ -4,6 +4,7 @@
 #include "Pathfinding/OctreePathfindingComponent.h"
 
 #include "GameFramework/FloatingPawnMovement.h"
+#include "Pathfinding/OctreePathfindingSubsystem.h"
 
 // Sets default values for this component's properties
 UOctreePathfindingComponent::UOctreePathfindingComponent()
@@ -33,10 +34,7 @@ void UOctreePathfindingComponent::BeginPlay()
 void UOctreePathfindingComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
-	if (PathfindingRunnable.IsValid())
-	{
-		PathfindingRunnable.Pin()->Stop();
-	}
+	CancelPathRequest();
 }
 
 void UOctreePathfindingComponent::GetAStarPathAsyncToLocation(FVector& TargetLocation, FVector& OutNextDirection)
@@ -54,19 +52,47 @@ void UOctreePathfindingComponent::GetAStarPathAsyncToTarget(const AActor* Target
 void UOctreePathfindingComponent::ForceStopPathfinding()
 {
 	StopPathfinding = true;
-	if (PathfindingRunnable.IsValid())
+	CancelPathRequest();
+}
+
+void UOctreePathfindingComponent::RestartPathfinding()
+{
+	StopPathfinding = false;
+}
+
+void UOctreePathfindingComponent::CancelPathRequest()
+{
+	if (!PathRequest.IsValid())
+	{
+		return;
+	}
+
+	if (const UOctreePathfindingSubsystem* Pathfinding = GetWorld()->GetSubsystem<UOctreePathfindingSubsystem>())
 	{
-		PathfindingRunnable.Pin()->PauseThread();
+		Pathfinding->GetService().Cancel(PathRequest);
 	}
+
+	PathRequest.Reset();
+	HasNewPath = false;
 }
 
-void UOctreePathfindingComponent::RestartPathfinding()
+void UOctreePathfindingComponent::OnPathFound(FPathfindingResult& Result)
 {
-	if (PathfindingRunnable.IsValid())
+	//An anytime search hands out better paths until it is done, the request is ours until then.
+	if (Result.Handle.Id == PathRequest.Id && Result.Done)
 	{
-		PathfindingRunnable.Pin()->ContinueThread();
+		PathRequest.Reset();
 	}
-	StopPathfinding = false;
+
+	//Not finding a path keeps the previous direction, see GetAStarPathAsync().
+	if (Result.Status != EPathfindingStatus::Found)
+	{
+		return;
+	}
+
+	//Our previous path goes back to the service, to be reused for a later one.
+	Swap(PathPoints, Result.Path);
+	HasNewPath = true;
 }
 
 FVector UOctreePathfindingComponent::PathSmoothing(const FVector& Start, const AActor* TargetActor, const TArray<FVector>& Path) const
@@ -82,6 +108,19 @@ FVector UOctreePathfindingComponent::PathSmoothing(const FVector& Start, const A
 	}
 
 	//Path smoothing. If the agent can skip a path point because it wouldn't collide, it should (skip). This ensures a more natural looking movement.
+	if (UseOctreeLineOfSight && OctreeWeakPtr.IsValid())
+	{
+		for (int i = 1; i < Path.Num(); i++)
+		{
+			if (!OctreeWeakPtr->HasLineOfSight(Start, Path[i], AgentMeshHalfSize))
+			{
+				return Path[i - 1];
+			}
+		}
+
+		return Path.Last();
+	}
+
 	FHitResult Hit;
 	FCollisionShape ColShape = FCollisionShape::MakeSphere(AgentMeshHalfSize);
 	FCollisionQueryParams TraceParams;
@@ -102,6 +141,55 @@ FVector UOctreePathfindingComponent::PathSmoothing(const FVector& Start, const A
 	return Path.Last();
 }
 
+void UOctreePathfindingComponent::SubmitSmoothingSweeps(const FVector& Start, const AActor* TargetActor, const TArray<FVector>& Path)
+{
+	if (Path.Num() < 3)
+	{
+		if (!Path.IsEmpty()) PreviousNextLocation = Path[0];
+		return;
+	}
+
+	//Any batch still in flight is for an older path.
+	SweepBatch++;
+	SweepPoints.Reset();
+	SweepPoints.Append(Path.GetData(), FMath::Min(Path.Num(), MaxSmoothingSweeps + 1));
+	SweepsLeft = SweepPoints.Num() - 1;
+	SweepBlocked.Init(false, SweepsLeft);
+
+	const FCollisionShape ColShape = FCollisionShape::MakeSphere(AgentMeshHalfSize);
+	FCollisionQueryParams TraceParams;
+	TraceParams.AddIgnoredActor(GetOwner());
+	if (TargetActor != nullptr) TraceParams.AddIgnoredActor(TargetActor);
+
+	const FTraceDelegate OnSweepDone = FTraceDelegate::CreateUObject(this, &UOctreePathfindingComponent::OnSmoothingSweepDone);
+
+	//The low byte of the user data is the sweep, the rest is the batch.
+	for (int32 i = 0; i < SweepsLeft; i++)
+	{
+		GetWorld()->AsyncSweepByChannel(EAsyncTraceType::Test, Start, SweepPoints[i + 1], FQuat::Identity, CollisionChannel, ColShape, TraceParams,
+		                                FCollisionResponseParams::DefaultResponseParam, &OnSweepDone, (SweepBatch << 8) | i);
+	}
+}
+
+void UOctreePathfindingComponent::OnSmoothingSweepDone(const FTraceHandle& Handle, FTraceDatum& Datum)
+{
+	if (Datum.UserData >> 8 != (SweepBatch & 0xFFFFFF) || SweepsLeft == 0)
+	{
+		return;
+	}
+
+	//Test sweeps only report a hit if there is a blocking one.
+	SweepBlocked[Datum.UserData & 0xFF] = !Datum.OutHits.IsEmpty();
+	if (--SweepsLeft > 0)
+	{
+		return;
+	}
+
+	//Same as PathSmoothing(), the point before the first blocked sweep.
+	const int32 FirstBlocked = SweepBlocked.Find(true);
+	PreviousNextLocation = FirstBlocked == INDEX_NONE ? SweepPoints.Last() : SweepPoints[FirstBlocked];
+}
+
 void UOctreePathfindingComponent::GetAStarPathAsync(const AActor* TargetActor, FVector& TargetLocation, FVector& OutNextDirection)
 {
 	if (StopPathfinding)
@@ -110,8 +198,9 @@ void UOctreePathfindingComponent::GetAStarPathAsync(const AActor* TargetActor, F
 		return;
 	}
 
-	if (!OctreeWeakPtr.IsValid() || !OctreeWeakPtr->IsOctreeSetup() || !PathfindingRunnable.IsValid())
-	//Worker gets deleted after Setup is set to false, so no need to check for nullptr
+	const TSharedPtr<FOctreeSearchGraph> Graph = SearchGraph.Pin();
+	if (!OctreeWeakPtr.IsValid() || !OctreeWeakPtr->IsOctreeSetup() || !Graph.IsValid())
+	//The graph is let go of after Setup is set to false, so no need to check for nullptr
 	{
 		UE_LOG(LogTemp, Warning, TEXT("Octree is not set up. Cannot do pathfinding."));
 		OutNextDirection = FVector::ZeroVector;
@@ -145,20 +234,43 @@ void UOctreePathfindingComponent::GetAStarPathAsync(const AActor* TargetActor, F
 		MovementComponent->MaxSpeed = OriginalSpeed;
 	}
 
-	//Checking if it's already working. If so, no need to add a new task to the queue.
-	if (PathfindingRunnable.Pin()->IsItWorking())
+	//Every agent of the octree shares one flow field toward the target set last, there is nothing to queue.
+	//Outside of the field, or while it heads for another target's leaf, the agent falls back to its own search below.
+	if (const TSharedPtr<FLinearOctreeFlowField> SharedFlowField = FlowField.Pin())
 	{
-		//Technically, we are always using a direction that is calculated in previous frame.
-		OutNextDirection = (PreviousNextLocation - Start).GetSafeNormal();
-		return;
+		SharedFlowField->SetTarget(TargetLocation);
+
+		FVector NextLocation;
+		if (SharedFlowField->GetNextLocation(Start, TargetLocation, NextLocation))
+		{
+			PreviousNextLocation = NextLocation;
+			OutNextDirection = (NextLocation - Start).GetSafeNormal();
+			return;
+		}
 	}
 
 	//While I did my best to ensure the Octree and its nodes are thread safe, I cannot ensure it with GetWorld as it is handled by the engine.
 	//That is why I need to do the path smoothing in the main thread, as it relies on objects that are not thread safe.
-	//If we are here, then we are about to start a new  pathfinding thread. This means that we can smooth out the previous one.
-	if (PathfindingRunnable.Pin()->GetFoundPath())
+	//Unless the octree does any-angle or funnel paths, those are straightened on the worker with the octree alone.
+	//A path came in since the last call, so we can smooth it out now.
+	if (HasNewPath)
 	{
-		PreviousNextLocation = PathSmoothing(Start, TargetActor, PathfindingRunnable.Pin()->GetOutQueue());
+		HasNewPath = false;
+
+		//Already straightened on the worker, the first point is as far as we can go in a straight line.
+		if (OctreeWeakPtr->ReturnsSmoothPaths())
+		{
+			if (!PathPoints.IsEmpty()) PreviousNextLocation = PathPoints[0];
+		}
+		else if (UseAsyncPathSmoothing && !UseOctreeLineOfSight)
+		{
+			//Until the sweeps are back, the agent keeps heading for the previous location.
+			SubmitSmoothingSweeps(Start, TargetActor, PathPoints);
+		}
+		else
+		{
+			PreviousNextLocation = PathSmoothing(Start, TargetActor, PathPoints);
+		}
 	}
 	/*
 	else
@@ -170,7 +282,18 @@ void UOctreePathfindingComponent::GetAStarPathAsync(const AActor* TargetActor, F
 	}
 	*/
 
-	if (Debug) UE_LOG(LogTemp, Warning, TEXT("Starting pathfinding."));
+	//Technically, we are always using a direction that is calculated in previous frame.
 	OutNextDirection = (PreviousNextLocation - Start).GetSafeNormal();
-	PathfindingRunnable.Pin()->AddToQueue(TPair<FVector, FVector>(Start, TargetLocation), true);
+
+	//The newest request replaces ours if it is still waiting in the queue. One that is already being searched carries on, its path will still
+	//be newer than the one we have.
+	UOctreePathfindingSubsystem* Pathfinding = GetWorld()->GetSubsystem<UOctreePathfindingSubsystem>();
+	if (Pathfinding == nullptr)
+	{
+		return;
+	}
+
+	if (Debug && !PathRequest.IsValid()) UE_LOG(LogTemp, Warning, TEXT("Starting pathfinding."));
+	PathRequest = Pathfinding->GetService().Submit(Graph, Start, TargetLocation, FOnPathfindingComplete::CreateUObject(this, &UOctreePathfindingComponent::OnPathFound),
+	                                               PathfindingPriority, PathRequestTimeout, static_cast<uint64>(reinterpret_cast<UPTRINT>(this)));
 }
@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/OctreePathfindingSubsystem.h"
+
+void UOctreePathfindingSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	//The workers are only started once an octree asks for them.
+	Service = MakeUnique<FPathfindingService>();
+}
+
+void UOctreePathfindingSubsystem::Deinitialize()
+{
+	//Stops the workers, after they are done with their current search.
+	Service.Reset();
+
+	Super::Deinitialize();
+}
+
+void UOctreePathfindingSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	Service->DispatchCompleted();
+}
+
+TStatId UOctreePathfindingSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UOctreePathfindingSubsystem, STATGROUP_Tickables);
+}
@@ -0,0 +1,491 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Pathfinding/PathfindingService.h"
+#include "Misc/ScopeRWLock.h"
+#include "Pathfinding/FPathfindingWorker.h"
+
+bool FOctreeSearchGraph::FindPath(const std::atomic<bool>& Cancelled, const uint64 AgentKey, const FVector& Start, const FVector& End,
+                                  const FOctreePathSettings& Settings, TArray<FVector>& OutPath)
+{
+	FSearchState& State = AcquireState(AgentKey);
+
+	bool PathFound;
+	if (LinearHierarchy.IsValid())
+	{
+		PathFound = OctreeGraph::HierarchicalLinearOctreeAStar(Cancelled, Debug, *LinearHierarchy, State.LinearScratch, Start, End, OutPath, Settings);
+	}
+	else if (LinearOctree.IsValid())
+	{
+		PathFound = OctreeGraph::LinearOctreeAStar(Cancelled, Debug, *LinearOctree, State.LinearScratch, Start, End, OutPath, Settings);
+	}
+	else
+	{
+		ApplyOverdueObstacleUpdates();
+		PathFound = OctreeGraph::LazyOctreeAStar(Cancelled, Debug, ActorBoxes, MinSize, Start, End, *NodeArena, State.LazyContext, OutPath, Settings);
+	}
+
+	ReleaseState(State);
+	return PathFound;
+}
+
+FOctreeSearchGraph::FSearchState& FOctreeSearchGraph::AcquireState(const uint64 AgentKey)
+{
+	FScopeLock Lock(&StateLock);
+
+	FSearchState* State = nullptr;
+	FSearchState* LeastRecent = nullptr;
+	for (const TUniquePtr<FSearchState>& Candidate : States)
+	{
+		if (Candidate->InUse) continue;
+
+		if (AgentKey != 0 && Candidate->AgentKey == AgentKey)
+		{
+			State = Candidate.Get();
+			break;
+		}
+
+		if (LeastRecent == nullptr || Candidate->LastUse < LeastRecent->LastUse) LeastRecent = Candidate.Get();
+	}
+
+	if (State == nullptr)
+	{
+		//Under the limit a new agent gets a state of its own, instead of taking the tree of another one.
+		State = LeastRecent != nullptr && States.Num() >= MaxAgentStates ? LeastRecent : States.Add_GetRef(MakeUnique<FSearchState>()).Get();
+
+		//Whatever tree it kept grew from another agent's start.
+		State->LazyContext.HasTree = false;
+		State->LinearScratch.HasTree = false;
+		State->AgentKey = AgentKey;
+	}
+
+	State->InUse = true;
+	State->LastUse = NextUse++;
+	return *State;
+}
+
+void FOctreeSearchGraph::ReleaseState(FSearchState& State)
+{
+	FScopeLock Lock(&StateLock);
+	State.InUse = false;
+}
+
+bool FOctreeSearchGraph::Raycast(const FVector& From, const FVector& To, const float Radius, FOctreeRaycastHit& OutHit) const
+{
+	if (LinearOctree.IsValid())
+	{
+		return LinearOctree->Raycast(From, To, Radius, OutHit);
+	}
+
+	OutHit = FOctreeRaycastHit();
+	if (!NodeArena.IsValid())
+	{
+		return false;
+	}
+
+	//The dynamic boxes only change under the write lock.
+	FReadScopeLock SearchScope(NodeArena->OccupancyLock);
+	FBox HitBox;
+	OutHit.Blocked = ActorBoxes.Raycast(From, To, Radius, OutHit.Time, HitBox);
+	OutHit.Location = From + (To - From) * OutHit.Time;
+	return OutHit.Blocked;
+}
+
+bool FOctreeSearchGraph::HasLineOfSight(const FVector& From, const FVector& To, const float Radius) const
+{
+	if (LinearOctree.IsValid())
+	{
+		return LinearOctree->HasLineOfSight(From, To, Radius);
+	}
+
+	if (!NodeArena.IsValid())
+	{
+		return true;
+	}
+
+	FReadScopeLock SearchScope(NodeArena->OccupancyLock);
+	return ActorBoxes.IsSegmentClear(From, To, Radius);
+}
+
+void FOctreeSearchGraph::FindNearestFreeLeaves(const FVector& Location, const float MaxRadius, const int32 Count, TArray<FBox>& OutLeaves) const
+{
+	if (LinearOctree.IsValid())
+	{
+		TArray<uint32> Cells;
+		LinearOctree->FindNearestFreeCells(Location, MaxRadius, Count, Cells);
+		for (const uint32 Cell : Cells)
+		{
+			OutLeaves.Add(LinearOctree->GetNodeBox(Cell));
+		}
+		return;
+	}
+
+	if (!NodeArena.IsValid())
+	{
+		return;
+	}
+
+	//Divides nodes like a search does, so it takes the same locks.
+	const std::atomic<bool> NeverPaused = false;
+	TArray<OctreeNode*> Leaves;
+	FReadScopeLock SearchScope(NodeArena->OccupancyLock);
+	FScopeLock DivideScope(&NodeArena->DivideLock);
+
+	OctreeGraph::FindNearestFreeLeaves(NeverPaused, *NodeArena, ActorBoxes, MinSize, Location, MaxRadius, Count, Leaves);
+	for (const OctreeNode* Leaf : Leaves)
+	{
+		OutLeaves.Add(FBox::BuildAABB(Leaf->Position, FVector(Leaf->HalfSize)));
+	}
+}
+
+int32 FOctreeSearchGraph::AddObstacle(const FBox& Box)
+{
+	FScopeLock Lock(&ObstacleLock);
+	const int32 Id = NextObstacleId++;
+	QueueObstacleUpdate({Id, Box, false});
+	return Id;
+}
+
+void FOctreeSearchGraph::MoveObstacle(const int32 Id, const FBox& Box)
+{
+	FScopeLock Lock(&ObstacleLock);
+	QueueObstacleUpdate({Id, Box, false});
+}
+
+void FOctreeSearchGraph::RemoveObstacle(const int32 Id)
+{
+	FScopeLock Lock(&ObstacleLock);
+	QueueObstacleUpdate({Id, FBox(ForceInit), true});
+}
+
+void FOctreeSearchGraph::QueueObstacleUpdate(const FObstacleUpdate& Update)
+{
+	if (PendingObstacles.IsEmpty())
+	{
+		ObstaclesPendingSince = FPlatformTime::Seconds();
+	}
+
+	PendingObstacles.Add(Update);
+	ObstaclesPending = true;
+}
+
+bool FOctreeSearchGraph::TryApplyObstacleUpdates()
+{
+	//Searches hold the read lock the whole time, so they only ever see the tree before or after all of the changes.
+	if (!ObstaclesPending || !NodeArena.IsValid() || !NodeArena->OccupancyLock.TryWriteLock())
+	{
+		return false;
+	}
+
+	ApplyObstacleUpdates();
+	NodeArena->OccupancyLock.WriteUnlock();
+	return true;
+}
+
+void FOctreeSearchGraph::ApplyOverdueObstacleUpdates()
+{
+	if (!ObstacleWriterWaiting)
+	{
+		if (!ObstaclesPending || TryApplyObstacleUpdates() || FPlatformTime::Seconds() - ObstaclesPendingSince < MaxObstacleDelay)
+		{
+			return;
+		}
+
+		//One search waits for the write lock, the others wait for that one below.
+		bool Expected = false;
+		if (ObstacleWriterWaiting.compare_exchange_strong(Expected, true))
+		{
+			//Only waits for the searches that started before the flag was set, and every one of them is bounded by its budget.
+			NodeArena->OccupancyLock.WriteLock();
+			if (ObstaclesPending)
+			{
+				ApplyObstacleUpdates();
+			}
+			NodeArena->OccupancyLock.WriteUnlock();
+
+			ObstacleWriterWaiting = false;
+			return;
+		}
+	}
+
+	//Another search is waiting to apply them. Starting this one now would only keep it waiting longer.
+	while (ObstacleWriterWaiting)
+	{
+		FPlatformProcess::Yield();
+	}
+}
+
+void FOctreeSearchGraph::ApplyObstacleUpdates()
+{
+	TArray<FObstacleUpdate> Updates;
+	{
+		FScopeLock Lock(&ObstacleLock);
+		Swap(Updates, PendingObstacles);
+		ObstaclesPending = false;
+	}
+
+	TArray<OctreeNode*> ChangedLeaves;
+	const auto Reclassify = [this, &ChangedLeaves](const FBox& Region)
+	{
+		//The root's children are always divided once they are looked up, same as in the eviction.
+		for (OctreeNode& Child : NodeArena->GetRoot()->GetChildren())
+		{
+			for (OctreeNode& GrandChild : Child.GetChildren())
+			{
+				OctreeGraph::ReclassifyLeaves(GrandChild, Region, ActorBoxes, MinSize, ChangedLeaves);
+			}
+		}
+	};
+
+	for (const FObstacleUpdate& Update : Updates)
+	{
+		const FBox* Previous = ActorBoxes.FindDynamicBox(Update.Id);
+		const FBox OldBox = Previous != nullptr ? *Previous : FBox(ForceInit);
+
+		if (Update.Removed)
+		{
+			ActorBoxes.RemoveDynamicBox(Update.Id);
+		}
+		else
+		{
+			ActorBoxes.SetDynamicBox(Update.Id, Update.Box);
+		}
+
+		//Where it was and where it is now, separately. Together they could cover half of the level.
+		if (OldBox.IsValid) Reclassify(OldBox);
+		if (!Update.Removed) Reclassify(Update.Box);
+	}
+
+	//Recycling invalidates every handle to the leaf, so the neighbors of a leaf that became occupied drop it, and the leaf finds its neighbors again.
+	for (OctreeNode* Leaf : ChangedLeaves)
+	{
+		NodeArena->RecycleNode(*Leaf);
+		OctreeGraph::InvalidateNeighbors(*NodeArena->GetRoot(), FBox::BuildAABB(Leaf->Position, FVector(Leaf->HalfSize)).ExpandBy(1));
+	}
+
+	//Kept search trees and flooded components were found on the old boxes, they start over.
+	NodeArena->Revision++;
+
+	if (Debug)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Octree obstacles: %i changes applied, %i leaves classified again."), Updates.Num(), ChangedLeaves.Num());
+	}
+}
+
+FPathfindingService::FPathfindingService()
+{
+	RequestEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+FPathfindingService::~FPathfindingService()
+{
+	Running = false;
+
+	{
+		FScopeLock Lock(&QueueLock);
+		for (const TPair<uint64, TSharedPtr<FRequest>>& Pair : Outstanding)
+		{
+			Pair.Value->Cancelled = true;
+		}
+	}
+
+	//Every worker that stops wakes the next one, see RequestEvent.
+	RequestEvent->Trigger();
+	for (const TUniquePtr<FResultRing>& Ring : ResultRings)
+	{
+		if (Ring.IsValid()) Ring->SpaceEvent->Trigger();
+	}
+	Workers.Empty();
+
+	FPlatformProcess::ReturnSynchEventToPool(RequestEvent);
+}
+
+void FPathfindingService::SetWorkerCount(const int32 Count)
+{
+	while (Workers.Num() < FMath::Min(Count, PathfindingService::MaxWorkers))
+	{
+		ResultRings[Workers.Num()] = MakeUnique<FResultRing>();
+		Workers.Add(MakeUnique<FPathfindingWorker>(*this, Workers.Num()));
+	}
+}
+
+FPathfindingRequestHandle FPathfindingService::Submit(const TSharedPtr<FOctreeSearchGraph>& Graph, const FVector& Start, const FVector& End,
+                                                      FOnPathfindingComplete OnComplete, const int32 Priority, const float Timeout, const uint64 AgentKey)
+{
+	TSharedPtr<FRequest> Request = MakeShared<FRequest>();
+	Request->AgentKey = AgentKey;
+	Request->Priority = Priority;
+	Request->Deadline = Timeout > 0 ? FPlatformTime::Seconds() + Timeout : 0;
+	Request->Start = Start;
+	Request->End = End;
+	Request->Graph = Graph;
+	Request->OnComplete = MoveTemp(OnComplete);
+
+	{
+		FScopeLock Lock(&QueueLock);
+		Request->Id = NextId++;
+
+		//The older request stays in the heap, it is skipped once it is popped.
+		if (AgentKey != 0)
+		{
+			TSharedPtr<FRequest>& Queued = QueuedByAgent.FindOrAdd(AgentKey);
+			if (Queued.IsValid())
+			{
+				Queued->Cancelled = true;
+				Outstanding.Remove(Queued->Id);
+			}
+			Queued = Request;
+		}
+
+		Outstanding.Add(Request->Id, Request);
+		Queue.HeapPush(Request, ComesFirst);
+	}
+
+	RequestEvent->Trigger();
+	return FPathfindingRequestHandle{Request->Id};
+}
+
+bool FPathfindingService::Cancel(const FPathfindingRequestHandle Handle)
+{
+	FScopeLock Lock(&QueueLock);
+
+	TSharedPtr<FRequest> Request;
+	if (!Outstanding.RemoveAndCopyValue(Handle.Id, Request))
+	{
+		return false;
+	}
+
+	Request->Cancelled = true;
+	if (Request->AgentKey != 0 && QueuedByAgent.FindRef(Request->AgentKey) == Request)
+	{
+		QueuedByAgent.Remove(Request->AgentKey);
+	}
+
+	return true;
+}
+
+void FPathfindingService::CancelAll(const FOctreeSearchGraph* Graph)
+{
+	FScopeLock Lock(&QueueLock);
+
+	for (auto It = Outstanding.CreateIterator(); It; ++It)
+	{
+		if (It.Value()->Graph.Get() != Graph) continue;
+
+		It.Value()->Cancelled = true;
+		if (It.Value()->AgentKey != 0 && QueuedByAgent.FindRef(It.Value()->AgentKey) == It.Value())
+		{
+			QueuedByAgent.Remove(It.Value()->AgentKey);
+		}
+		It.RemoveCurrent();
+	}
+}
+
+TSharedPtr<FPathfindingService::FRequest> FPathfindingService::WaitForRequest()
+{
+	while (Running)
+	{
+		{
+			FScopeLock Lock(&QueueLock);
+
+			while (!Queue.IsEmpty())
+			{
+				TSharedPtr<FRequest> Request;
+				Queue.HeapPop(Request, ComesFirst, EAllowShrinking::No);
+
+				if (Request->Cancelled) continue;
+
+				if (Request->AgentKey != 0)
+				{
+					QueuedByAgent.Remove(Request->AgentKey);
+				}
+
+				//Passing the wake up on, another worker can take the next one.
+				if (!Queue.IsEmpty())
+				{
+					RequestEvent->Trigger();
+				}
+
+				return Request;
+			}
+		}
+
+		RequestEvent->Wait();
+	}
+
+	//Passing the wake up on, so the other workers stop too.
+	RequestEvent->Trigger();
+	return nullptr;
+}
+
+FPathfindingService::FResultSlot* FPathfindingService::BeginResult(const int32 WorkerIndex)
+{
+	FResultRing& Ring = *ResultRings[WorkerIndex];
+	const uint32 Head = Ring.Head.load(std::memory_order_relaxed);
+
+	//Only full if the game thread stopped dispatching, like while the world is torn down.
+	while (Head - Ring.Tail.load(std::memory_order_acquire) == FResultRing::Capacity)
+	{
+		if (!Running) return nullptr;
+		Ring.SpaceEvent->Wait();
+	}
+
+	FResultSlot& Slot = Ring.Slots[Head % FResultRing::Capacity];
+	Slot.Path.Reset();
+	return &Slot;
+}
+
+void FPathfindingService::EndResult(const int32 WorkerIndex, const bool Done)
+{
+	FResultRing& Ring = *ResultRings[WorkerIndex];
+	const uint32 Head = Ring.Head.load(std::memory_order_relaxed);
+	FResultSlot& Slot = Ring.Slots[Head % FResultRing::Capacity];
+	Slot.Done = Done;
+
+	if (Done)
+	{
+		FScopeLock Lock(&QueueLock);
+		Outstanding.Remove(Slot.Request->Id);
+	}
+
+	//Release, so the game thread sees the whole slot once it sees the new head.
+	Ring.Head.store(Head + 1, std::memory_order_release);
+}
+
+void FPathfindingService::DispatchCompleted()
+{
+	FPathfindingResult Result;
+
+	for (const TUniquePtr<FResultRing>& RingPtr : ResultRings)
+	{
+		if (!RingPtr.IsValid()) continue;
+
+		FResultRing& Ring = *RingPtr;
+		const uint32 Head = Ring.Head.load(std::memory_order_acquire);
+		uint32 Tail = Ring.Tail.load(std::memory_order_relaxed);
+		if (Tail == Head) continue;
+
+		for (; Tail != Head; Tail++)
+		{
+			FResultSlot& Slot = Ring.Slots[Tail % FResultRing::Capacity];
+
+			//Cancelled after it was done, the agent does not want it anymore.
+			if (!Slot.Request->Cancelled)
+			{
+				Result.Handle.Id = Slot.Request->Id;
+				Result.Status = Slot.Status;
+				Result.Done = Slot.Done;
+
+				//Swapped in and back out, whatever buffer the receiver left in the result goes back to the slot.
+				Swap(Result.Path, Slot.Path);
+				Slot.Request->OnComplete.ExecuteIfBound(Result);
+				Swap(Result.Path, Slot.Path);
+			}
+
+			Slot.Request.Reset();
+		}
+
+		//Release, so the worker only reuses the slots once we are done with them.
+		Ring.Tail.store(Tail, std::memory_order_release);
+		Ring.SpaceEvent->Trigger();
+	}
+}
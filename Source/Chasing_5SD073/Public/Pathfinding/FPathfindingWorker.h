@@ -3,75 +3,73 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include "OctreeNode.h"
+#include "LinearOctreeFlowField.h"
+#include "PathfindingService.h"
 
 /**
- * 
+ * A thread of the pathfinding service, searching one request at a time. It sleeps on the service's event while there is nothing to do.
+ * The flow field of an octree gets a worker of its own, which sleeps on its own event until the target moves.
  */
 class CHASING_5SD073_API FPathfindingWorker : public FRunnable
 {
 public:
 
-	FPathfindingWorker(const TWeakPtr<OctreeNode>& InOctreeNode, bool& InDebug, const TArray<FBox>& InActorBoxes, const float InMinSize) : OctreeRootNode(InOctreeNode), ActorBoxes(InActorBoxes), MinSize(InMinSize), Debug(InDebug)
+	/// @param InWorkerIndex Which of the service's result rings this worker hands its results to. Search states belong to the agents, not the workers.
+	FPathfindingWorker(FPathfindingService& InService, const int32 InWorkerIndex) : Service(&InService), WorkerIndex(InWorkerIndex), Debug(NoDebug)
 	{
 		Thread = FRunnableThread::Create(this, TEXT("PathfindingThread"));
 	}
 
+	//Keeps the flow field up to date instead of searching paths, the agents read it on their own.
+	FPathfindingWorker(const TSharedPtr<FLinearOctree>& InLinearOctree, const TSharedPtr<FLinearOctreeFlowField>& InFlowField, bool& InDebug) : LinearOctree(InLinearOctree), FlowField(InFlowField), Debug(InDebug)
+	{
+		WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		Thread = FRunnableThread::Create(this, TEXT("FlowFieldThread"));
+		FlowField->SetWakeEvent(WorkEvent);
+	}
+
 	virtual ~FPathfindingWorker() override
 	{
 		bRunThread = false;
-		
+
 		if (Thread)
 		{
+			if (WorkEvent) WorkEvent->Trigger();
 			// Kill() is a blocking call, it waits for the thread to finish.
 			Thread->WaitForCompletion();
 			Thread->Kill();
 			delete Thread;
 		}
-	}
-
-	virtual uint32 Run() override;
-
-	TArray<FVector> GetPathPoints() const
-	{
-		return PathPoints;
-	}
 
-
-	bool GetFoundPath() const
-	{
-		return PathFound;
+		if (FlowField.IsValid())
+		{
+			FlowField->SetWakeEvent(nullptr);
+			FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+		}
 	}
 
-	bool IsItWorking() const
-	{
-		return IsWorking && bRunThread;
-	}
+	virtual uint32 Run() override;
 
 	virtual void Stop() override;
 
-	void ContinueThread();
-	void PauseThread();
+private:
+	FRunnableThread* Thread = nullptr;
 
+	//Service workers only.
+	FPathfindingService* Service = nullptr;
+	int32 WorkerIndex = 0;
+	//What the search writes into, traded with the buffer of the result slot it goes to.
+	TArray<FVector> Path;
 
-	/// @param Task of FVector, FVector where the first FVector is the start location and the second is the end location.
-	/// @param MoveOnToNextTask if true, the thread will start working on the task immediately.
-	void AddToQueue(const TPair<FVector, FVector>& Task, const bool MoveOnToNextTask = false);
-	//Returns the oldest task's results.
-	TArray<FVector> GetOutQueue();
+	//Flow field worker only. Auto reset, so a trigger while the field is being built is not lost.
+	TSharedPtr<FLinearOctree> LinearOctree;
+	TSharedPtr<FLinearOctreeFlowField> FlowField;
+	FEvent* WorkEvent = nullptr;
+	//The flow field is never paused.
+	const std::atomic<bool> ThreadIsPaused = false;
 
-private:
-	bool ThreadIsPaused = false;
-	FRunnableThread* Thread;
-	TWeakPtr<OctreeNode> OctreeRootNode;
-	TQueue<TPair<FVector, FVector>> TaskQueue;
-	TArray<FVector> PathPoints;
-	
-	TArray<FBox> ActorBoxes;
-	float MinSize;
-	
-	bool bRunThread = true;
-	bool PathFound = false;
-	bool IsWorking = false;
+	std::atomic<bool> bRunThread = true;
 	bool& Debug;
+	//What Debug refers to for service workers, which take it from the search graph of every request instead.
+	inline static bool NoDebug = false;
 };
@@ -0,0 +1,225 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OctreeBoxIndex.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/* A pointer-free alternative to the OctreeNode tree.
+ *
+ * All nodes live in one contiguous pool and are addressed by 32-bit indices. The 8 children of a node are always allocated together,
+ * so a node only needs to know the index of its first child. Position and size are not stored at all: every node carries a Morton (Z-order)
+ * location code, from which its depth and integer coordinates (and therefore its box) can be decoded.
+ *
+ * Unlike the lazy OctreeNode tree, the linear octree is fully built once and is read-only afterwards.
+ * Descending it is a handful of comparisons per level and touches no reference counts.
+ *
+ * Because the nodes are plain data with no pointers, a built octree can be baked into a file and read back in place.
+ * A baked octree is memory mapped (or read with a single allocation where mapping is not available) instead of being rebuilt.
+ *
+ * The two finest levels are not stored as nodes. An occupied node 4 times the min size becomes a brick instead: a 4x4x4 block of
+ * min size voxels whose occupancy is a single 64-bit mask. Searches address the voxels like nodes, with indices past the last node
+ * (see NumCells()), and find the free voxels around them with bit operations on the mask.
+ */
+
+namespace LinearOctree
+{
+	inline constexpr uint32 InvalidIndex = MAX_uint32;
+
+	//21 bits per axis is what fits in a 64-bit location code (3 * 21 + 1 sentinel bit).
+	inline constexpr int32 MaxDepth = 21;
+
+	//Bricks cover the 2 finest levels, 4 voxels per axis.
+	inline constexpr int32 BrickLevels = 2;
+	inline constexpr uint32 BrickSize = 1 << BrickLevels;
+	inline constexpr uint32 VoxelsPerBrick = BrickSize * BrickSize * BrickSize;
+
+	//Interleaves the lower 21 bits of X, Y and Z into a 63-bit Morton code. X ends up in bit 0, Y in bit 1 and Z in bit 2.
+	uint64 EncodeMorton(const uint32 X, const uint32 Y, const uint32 Z);
+	void DecodeMorton(const uint64 Morton, uint32& OutX, uint32& OutY, uint32& OutZ);
+}
+
+struct CHASING_5SD073_API FLinearOctreeNode
+{
+	enum EFlags : uint8
+	{
+		Occupied = 1 << 0,
+		//Set on occupied nodes that were not fully inside an object and are bigger than the min size.
+		Divisible = 1 << 1,
+		//FirstChild is the index of a brick instead of a child.
+		Brick = 1 << 2,
+	};
+
+	//Sentinel bit followed by 3 bits per level. The root is 1, a child is (ParentCode << 3) | ChildIndex.
+	uint64 LocationCode = 1;
+
+	//Index of the first of the 8 children, the brick index for brick nodes, or InvalidIndex for leaves.
+	uint32 FirstChild = LinearOctree::InvalidIndex;
+
+	uint8 Flags = 0;
+
+	//Explicit padding, so baked files contain no uninitialized bytes.
+	uint8 Reserved[3] = {0, 0, 0};
+
+	bool IsLeaf() const { return FirstChild == LinearOctree::InvalidIndex; }
+	bool IsOccupied() const { return (Flags & Occupied) != 0; }
+	bool IsDivisible() const { return (Flags & Divisible) != 0; }
+	bool IsBrick() const { return (Flags & Brick) != 0; }
+	int32 GetDepth() const { return static_cast<int32>(FMath::FloorLog2_64(LocationCode) / 3); }
+	uint64 GetMorton() const { return LocationCode ^ (1ull << (GetDepth() * 3)); }
+};
+
+struct CHASING_5SD073_API FLinearOctreeBrick
+{
+	//Bit X + 4 * Y + 16 * Z is set if that voxel is occupied.
+	uint64 OccupiedVoxels = 0;
+
+	//The node the brick replaces the children of.
+	uint32 Node = LinearOctree::InvalidIndex;
+
+	uint32 Reserved = 0;
+};
+
+//What a raycast through the octree ran into.
+struct FOctreeRaycastHit
+{
+	bool Blocked = false;
+	//The occupied leaf or voxel. InvalidIndex if the segment left the octree, or if the octree has no cells (the pointer backend).
+	uint32 Cell = LinearOctree::InvalidIndex;
+	//Fraction of the segment covered before the hit, and where the segment (the center of the sphere for a sweep) was then.
+	float Time = 1.0f;
+	FVector Location = FVector::ZeroVector;
+};
+
+class CHASING_5SD073_API FLinearOctree
+{
+public:
+	/// @param InBounds The volume the octree has to cover. The root is centered on it and rounded up to a power of 2 multiple of the min size.
+	FLinearOctree(const FBox& InBounds, const float InMinNodeSize);
+
+	~FLinearOctree();
+
+	//Subdivides every occupied node down to the min node size. Either this or LoadBake() must be called before the octree is used.
+	void Build(const FOctreeBoxIndex& ActorBoxes);
+
+	//Writes the built octree to a bake file. The geometry hash is stored so the bake can be matched with the level later.
+	bool SaveBake(const FString& FilePath, const uint64 GeometryHash) const;
+
+	//Uses a bake file instead of building. Fails if the file is missing, corrupt, or was baked for other geometry, bounds or min size.
+	bool LoadBake(const FString& FilePath, const uint64 GeometryHash);
+
+	//Order independent hash of everything that affects the built octree.
+	static uint64 HashGeometry(const FBox& Bounds, const float MinNodeSize, const TArray<FBox>& ActorBoxes);
+
+	//The functions below take and return cells: either a node index or a brick voxel index (NumNodes() and up).
+
+	//Returns the leaf or voxel containing the location, or InvalidIndex if it is outside the octree.
+	//If the leaf is occupied and we are not looking for a neighbor, the closest unoccupied sibling (or voxel of the same brick) is returned instead, if there is one.
+	uint32 FindLeaf(const FVector& Location, const bool LookingForNeighbor = false) const;
+
+	//Appends up to Count free leaves and voxels, nearest to the location first, none further than MaxRadius from it. The tree is walked
+	//best first on the distance to the node boxes, so only the nodes closer than the last one returned are opened.
+	void FindNearestFreeCells(const FVector& Location, const float MaxRadius, const int32 Count, TArray<uint32>& OutCells) const;
+
+	//Appends the unoccupied leaves and voxels that share a face with the given cell. Costs one descent per face plus the number of neighbors,
+	//neighbors inside the same brick cost nothing but a few bit operations.
+	void GetNeighbors(const uint32 NodeIndex, TArray<uint32>& OutNeighbors) const;
+
+	//True if every cell the segment passes through is free. With a radius, 4 more segments offset by it around the first one are tested too.
+	//Costs one descent per cell crossed.
+	bool HasLineOfSight(const FVector& From, const FVector& To, const float Radius = 0) const;
+
+	//Same walk as HasLineOfSight(), but returns the first occupied cell it enters instead of stopping at any. Leaving the octree counts as a hit.
+	bool Raycast(const FVector& From, const FVector& To, const float Radius, FOctreeRaycastHit& OutHit) const;
+
+	//Labels every free cell with the part of the free space it is in, so searches between parts that are not connected can fail right away.
+	//Optional. Call once after Build() or LoadBake(), before the octree is shared. Costs a flood fill over every free cell.
+	void LabelComponents();
+	bool HasComponents() const { return !CellComponents.IsEmpty(); }
+	//InvalidIndex for occupied cells and internal nodes, or if the components were not labelled.
+	uint32 GetComponent(const uint32 Cell) const { return CellComponents.IsValidIndex(Cell) ? CellComponents[Cell] : LinearOctree::InvalidIndex; }
+	int32 NumComponents() const { return ComponentCount; }
+
+	FVector GetNodeCenter(const uint32 NodeIndex) const;
+	float GetNodeHalfSize(const uint32 NodeIndex) const;
+	FBox GetNodeBox(const uint32 NodeIndex) const;
+	bool IsOccupied(const uint32 NodeIndex) const;
+
+	bool IsVoxel(const uint32 NodeIndex) const { return NodeIndex >= static_cast<uint32>(NodeCount); }
+	const FLinearOctreeNode& GetNode(const uint32 NodeIndex) const { return NodeData[NodeIndex]; }
+	const FLinearOctreeBrick& GetBrick(const uint32 BrickIndex) const { return BrickData[BrickIndex]; }
+	uint32 GetParent(const uint32 NodeIndex) const;
+
+	int32 NumNodes() const { return NodeCount; }
+	int32 NumBricks() const { return BrickCount; }
+	//Every cell index is below this, so searches can size per cell arrays with it.
+	int32 NumCells() const { return NodeCount + BrickCount * LinearOctree::VoxelsPerBrick; }
+
+	int32 GetMaxDepth() const { return LeafDepth; }
+	const FBox& GetBounds() const { return Bounds; }
+	bool IsBaked() const { return Nodes.IsEmpty() && NodeCount > 0; }
+
+	//Size of the node and brick data, whether it is owned or mapped from a bake.
+	SIZE_T GetAllocatedSize() const
+	{
+		return NodeCount * sizeof(FLinearOctreeNode) + BrickCount * sizeof(FLinearOctreeBrick) + (NodeCount / 8) * sizeof(uint32) + CellComponents.GetAllocatedSize();
+	}
+
+private:
+	//Points the read-only view at the owned arrays. Needed after every append while building.
+	void RefreshView();
+
+	void Subdivide(const uint32 NodeIndex, const FOctreeBoxIndex& ActorBoxes);
+	void MakeBrick(const uint32 NodeIndex, const FOctreeBoxIndex& ActorBoxes);
+	uint8 ClassifyNode(const FBox& NodeBox, const int32 Depth, const FOctreeBoxIndex& ActorBoxes) const;
+
+	//Walks down towards the cell with the given coordinates at the given depth. Stops early if a leaf is hit.
+	uint32 DescendTo(const uint32 X, const uint32 Y, const uint32 Z, const int32 Depth) const;
+
+	//Integer coordinates of the cell at its own depth.
+	void GetCellCoordinates(const uint32 NodeIndex, uint32 (&OutCoordinates)[3], int32& OutDepth) const;
+
+	uint32 GetVoxelIndex(const uint32 BrickIndex, const uint32 Voxel) const { return NodeCount + BrickIndex * LinearOctree::VoxelsPerBrick + Voxel; }
+
+	//Steps from cell to cell along the segment, a 3D DDA over the leaves. Returns true and fills the hit at the first occupied cell.
+	bool TraceSegment(const FVector& From, const FVector& To, FOctreeRaycastHit& OutHit) const;
+
+	//The leaf or voxel containing the location, occupied or not. InvalidIndex outside of the octree.
+	uint32 FindCell(const FVector& Location) const;
+
+	//Collects the unoccupied leaves and voxels of the subtree whose face is on the given side of the given axis.
+	void GatherFaceLeaves(const uint32 NodeIndex, const int32 Axis, const uint32 Side, TArray<uint32>& OutLeaves) const;
+
+	//The root is at index 0, every other node at 1 + 8 * BlockIndex + ChildIndex.
+	//Only used while building. Everything else reads through NodeData, which may point into a bake instead.
+	TArray<FLinearOctreeNode> Nodes;
+
+	//The parent of every block of 8 children. Cheaper than storing a parent per node.
+	TArray<uint32> BlockParents;
+
+	TArray<FLinearOctreeBrick> Bricks;
+
+	//Component of every cell, see LabelComponents(). Not part of the bake, it is labelled again after loading.
+	TArray<uint32> CellComponents;
+	int32 ComponentCount = 0;
+
+	const FLinearOctreeNode* NodeData = nullptr;
+	const FLinearOctreeBrick* BrickData = nullptr;
+	const uint32* BlockParentData = nullptr;
+	int32 NodeCount = 0;
+	int32 BrickCount = 0;
+
+	//Backing memory of a loaded bake. The region has to be released before the handle, hence the order.
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	TArray<uint8> BakeBuffer;
+
+	FBox Bounds;
+	FVector RootMin;
+	float RootHalfSize;
+	float MinNodeSize;
+	int32 LeafDepth = 0;
+};
@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LinearOctree.h"
+
+/* Flow field over a linear octree, toward a single target shared by many agents.
+ *
+ * There is only ever one target, the one set last. Agents chasing something else must not follow the field, GetNextLocation() checks
+ * the caller's target against the leaf the front field was built for and turns them away.
+ *
+ * One Dijkstra search runs outward from the target's leaf and stores, for every leaf it reaches, the neighbor that is one step closer
+ * to the target. An agent then only has to find its own leaf to know where to go next, no matter how many agents there are.
+ *
+ * The field is double buffered. Refresh() builds the next field into the back buffer on a worker thread while the agents keep reading
+ * the front one, and swaps them when it is done. A build is always finished before the next one starts, so a target that keeps moving
+ * cannot starve it. A target that stays in the same leaf costs nothing at all.
+ *
+ * It must not outlive the octree.
+ */
+class CHASING_5SD073_API FLinearOctreeFlowField
+{
+public:
+	FLinearOctreeFlowField(const FLinearOctree& InOctree);
+
+	//Any thread. The next build heads for this location, the current field keeps its own target leaf until then.
+	void SetTarget(const FVector& TargetLocation);
+
+	//Triggered by every SetTarget(), so the refreshing thread can sleep while the target holds still. Null to stop.
+	void SetWakeEvent(FEvent* Event);
+
+	//Continues the build in progress, or starts one if the target is in another leaf than the front field's. Returns true if the buffers
+	//were swapped. Only one thread may refresh, it stops early if the thread is paused and carries on with the next call.
+	bool Refresh(const std::atomic<bool>& ThreadIsPaused, const bool& Debug);
+
+	//Any thread. Where to head from the given location toward the given target: the center of the next leaf, or the target itself once
+	//in the target's leaf. False if there is no field yet, the front field was built toward another leaf than the target's, or the
+	//location is outside of the field (occupied, or not connected to the target).
+	bool GetNextLocation(const FVector& From, const FVector& Target, FVector& OutLocation) const;
+
+	bool HasField() const;
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FField
+	{
+		//Next cell toward the target, InvalidIndex for the target cell itself.
+		TArray<uint32> Next;
+		TArray<float> Distance;
+		//Cells reached by the build with this buffer's stamp belong to its field.
+		TArray<uint32> CellStamp;
+		uint32 Stamp = 0;
+		uint32 TargetCell = LinearOctree::InvalidIndex;
+
+		bool Contains(const uint32 Cell) const { return CellStamp[Cell] == Stamp; }
+	};
+
+	struct FOpenEntry
+	{
+		float Distance;
+		uint32 Cell;
+
+		bool operator<(const FOpenEntry& Other) const { return Distance < Other.Distance; }
+	};
+
+	const FLinearOctree& Octree;
+
+	FField Fields[2];
+	//Only changes under SwapLock for writing, agents hold it for reading while they look up the front field.
+	int32 FrontField = 0;
+	mutable FRWLock SwapLock;
+
+	//Latest target from SetTarget().
+	FVector TargetLocation = FVector::ZeroVector;
+	bool HasTarget = false;
+	FEvent* WakeEvent = nullptr;
+	FCriticalSection TargetLock;
+
+	//State of the build in the back buffer, only touched by the refreshing thread.
+	TArray<FOpenEntry> OpenHeap;
+	TArray<uint32> Neighbors;
+	bool Building = false;
+	double BuildTime = 0;
+};
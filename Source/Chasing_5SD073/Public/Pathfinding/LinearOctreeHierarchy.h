@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LinearOctree.h"
+
+/* Coarse graph over a linear octree, for hierarchical (HPA*-style) searches.
+ *
+ * The octree is cut into clusters: every node at the cluster depth, plus the leaves above it (large free or fully occupied nodes).
+ * Two clusters are connected if at least one free cell of one shares a face with a free cell of the other, a portal.
+ * A search first finds a path over the clusters, then runs the regular search only inside the clusters of that path.
+ *
+ * Built once from a built or baked octree and read-only afterwards, so any number of workers can share it. It must not outlive the octree.
+ */
+class CHASING_5SD073_API FLinearOctreeHierarchy
+{
+public:
+	/// @param ClusterLevels How many levels above the leaves the clusters are. 3 makes clusters of up to 8x8x8 min size cells.
+	FLinearOctreeHierarchy(const FLinearOctree& InOctree, const int32 ClusterLevels = 3);
+
+	//Cluster of the given cell (node or voxel), InvalidIndex for internal nodes above the cluster depth.
+	uint32 GetCluster(const uint32 CellIndex) const;
+
+	//Clusters sharing a portal with the given one.
+	TArrayView<const uint32> GetLinkedClusters(const uint32 Cluster) const
+	{
+		return TArrayView<const uint32>(Links.GetData() + LinkStarts[Cluster], LinkStarts[Cluster + 1] - LinkStarts[Cluster]);
+	}
+
+	const FVector& GetClusterCenter(const uint32 Cluster) const { return ClusterCenters[Cluster]; }
+
+	int32 NumClusters() const { return ClusterCenters.Num(); }
+	int32 NumLinks() const { return Links.Num(); }
+	int32 GetClusterDepth() const { return ClusterDepth; }
+	const FLinearOctree& GetOctree() const { return Octree; }
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return NodeClusters.GetAllocatedSize() + ClusterCenters.GetAllocatedSize() + LinkStarts.GetAllocatedSize() + Links.GetAllocatedSize();
+	}
+
+private:
+	const FLinearOctree& Octree;
+	int32 ClusterDepth = 0;
+
+	//Cluster of every node. Voxels use the one of their brick's node.
+	TArray<uint32> NodeClusters;
+	TArray<FVector> ClusterCenters;
+
+	//Links of cluster i are Links[LinkStarts[i]] to Links[LinkStarts[i + 1]], both directions are stored.
+	TArray<uint32> LinkStarts;
+	TArray<uint32> Links;
+};
@@ -3,11 +3,21 @@
 #include "CoreMinimal.h"
 #include "FPathfindingWorker.h"
 #include "GameFramework/Actor.h"
+#include "LinearOctree.h"
 #include "OctreeNode.h"
 #include "Octree.generated.h"
 
 class UProceduralMeshComponent;
 
+UENUM(BlueprintType)
+enum class EOctreeBackend : uint8
+{
+	//Nodes in a per-octree arena, reached through raw pointers and generation checked handles. Divided lazily while paths are searched.
+	Pointer,
+	//Flat, index-addressed nodes with Morton location codes. Fully divided at setup and read-only afterwards.
+	Linear
+};
+
 UCLASS()
 class CHASING_5SD073_API AOctree : public AActor
 {
@@ -15,11 +25,35 @@ class CHASING_5SD073_API AOctree : public AActor
 
 public:
 	AOctree();
-	TSharedPtr<OctreeNode> GetRootNode() const { return RootNodeSharedPtr; }
+	OctreeNode* GetRootNode() const { return NodeArena.IsValid() ? NodeArena->GetRoot() : nullptr; }
+	TSharedPtr<FLinearOctree> GetLinearOctree() const { return LinearOctree; }
 	ECollisionChannel GetCollisionChannel() const { return CollisionChannel; }
 	bool IsOctreeSetup() const { return IsSetup; }
+	//Any-angle and funnel paths are already straight and clear of the octree, the agents do not need to sweep them.
+	bool ReturnsSmoothPaths() const { return UseAnyAnglePaths || UseFunnelPaths; }
+
+	//What the agents submit their requests on, to the pathfinding service of the world.
+	TWeakPtr<FOctreeSearchGraph> GetSearchGraph() const { return SearchGraph; }
+
+	//Walks the segment through the occupancy of the octree instead of the physics scene, sweeping a sphere of the radius.
+	//Only sees what the octree was built from and its dynamic obstacles. Other threads call it on the pinned search graph.
+	bool Raycast(const FVector& From, const FVector& To, const float Radius, FOctreeRaycastHit& OutHit) const;
+	bool HasLineOfSight(const FVector& From, const FVector& To, const float Radius = 0) const;
+
+	//The free leaves nearest to the location, nearest first. At most Count of them, none further than MaxRadius. Same threading as Raycast().
+	void FindNearestFreeLeaves(const FVector& Location, const float MaxRadius, const int32 Count, TArray<FBox>& OutLeaves) const;
+	//Moves the location into free space: the closest point of the nearest free leaf. False if there is none within MaxRadius.
+	bool SnapToFreeSpace(const FVector& Location, const float MaxRadius, FVector& OutLocation) const;
+
+	//Boxes that can move or go away after the octree is set up, pointer backend only. The linear octree is read-only once it is built.
+	//Returns the id to move and remove it with, INDEX_NONE on the linear backend. The changes are applied once no search is running,
+	//or after ObstacleUpdateMaxDelay at the latest.
+	int32 AddObstacle(const FBox& Box);
+	void MoveObstacle(const int32 Id, const FBox& Box);
+	void RemoveObstacle(const int32 Id);
 
-	TWeakPtr<FPathfindingWorker> GetPathfindingRunnable() const { return PathfindingWorker; }
+	//Only valid if UseFlowField is set.
+	TWeakPtr<FLinearOctreeFlowField> GetFlowField() const { return FlowField; }
 
 protected:
 	virtual void BeginPlay() override;
@@ -71,13 +105,95 @@ private:
 	UFUNCTION(CallInEditor, Category="Octree")
 	void DeleteGrid();
 	void DrawLine(const FVector& Start, const FVector& End, const FVector& Normal, TArray<FVector>& Vertices, TArray<int32>& Triangles) const;
+	void DrawNodeBorders(const FVector& Center, const FVector& Extent, TArray<FVector>& Vertices, TArray<int32>& Triangles) const;
 
 	
 
 
 #pragma endregion
 
-	TSharedPtr<OctreeNode> RootNodeSharedPtr = nullptr;
+#pragma region Baking
+
+	//Fully divides the octree and writes it to a bake file, which the linear backend then loads instead of building at BeginPlay.
+	//If the geometry did not change since the last bake, the existing file is reused.
+	UFUNCTION(CallInEditor, Category="Octree|Bake")
+	void BakeOctree();
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree|Bake", meta = (AllowPrivateAccess = "true"))
+	bool UseBakedOctree = true;
+
+	//Identifies the bake file of this octree. 0 if it was never baked.
+	UPROPERTY(VisibleAnywhere, Category = "Octree|Bake", meta = (AllowPrivateAccess = "true"))
+	uint64 BakedGeometryHash = 0;
+
+	static FString GetBakeFilePath(const uint64 GeometryHash);
+
+	//Loads the bake into the linear octree. Returns false if there is no usable bake, in which case the octree has to be built.
+	bool LoadBakedOctree();
+
+#pragma endregion
+
+#pragma region Benchmarks
+
+	//Builds both backends over the current level and logs descent times and memory per node.
+	UFUNCTION(CallInEditor, Category="Octree|Benchmark")
+	void BenchmarkBackends();
+
+	UPROPERTY(EditAnywhere, Category = "Octree|Benchmark", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 BenchmarkQueryCount = 100000;
+
+	//Compares the box index against testing every box, with 1k, 10k and 100k random boxes inside the volume.
+	UFUNCTION(CallInEditor, Category="Octree|Benchmark")
+	void BenchmarkBoxIndex();
+
+	//Runs the same random paths on 1 to 16 threads at once against one octree, for both backends, and logs how the throughput scales.
+	UFUNCTION(CallInEditor, Category="Octree|Benchmark")
+	void BenchmarkConcurrentSearches();
+
+	UPROPERTY(EditAnywhere, Category = "Octree|Benchmark", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 BenchmarkPathCount = 512;
+
+	//Compares the flat and the hierarchical linear search on paths across at least half the volume.
+	UFUNCTION(CallInEditor, Category="Octree|Benchmark")
+	void BenchmarkHierarchicalSearch();
+
+	//An agent chasing a target that moves a little between queries, searched from scratch every time and then incrementally.
+	UFUNCTION(CallInEditor, Category="Octree|Benchmark")
+	void BenchmarkMovingTarget();
+
+	//BenchmarkAgentCount agents chasing one target, each searching its own path against all of them following one flow field.
+	UFUNCTION(CallInEditor, Category="Octree|Benchmark")
+	void BenchmarkFlowField();
+
+	UPROPERTY(EditAnywhere, Category = "Octree|Benchmark", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	int32 BenchmarkAgentCount = 20;
+
+	//What the benchmarks run on: the boxes of the level and a linear octree over them, with the same random numbers every time.
+	struct FBenchmarkFixture
+	{
+		FOctreeBoxIndex Boxes;
+		FBox VolumeBounds = FBox(ForceInit);
+		TUniquePtr<FLinearOctree> Linear;
+		FRandomStream Random = FRandomStream(1234);
+		const std::atomic<bool> ThreadIsPaused = false;
+		const bool NoDebug = false;
+	};
+
+	//Without BuildLinear, the linear octree is left for the benchmark to build, so it can time it.
+	void MakeBenchmarkFixture(FBenchmarkFixture& OutFixture, const bool BuildLinear = true) const;
+
+#pragma endregion
+
+	//Owns the pointer backend's nodes, starting with the root.
+	TSharedPtr<FOctreeNodeArena> NodeArena = nullptr;
+	TSharedPtr<FLinearOctree> LinearOctree = nullptr;
+	//Only made if UseHierarchicalSearch is set. Declared after the octree it points into, so it is destroyed first.
+	TSharedPtr<FLinearOctreeHierarchy> LinearHierarchy = nullptr;
+	//Only made if UseFlowField is set, same as the hierarchy.
+	TSharedPtr<FLinearOctreeFlowField> FlowField = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
+	EOctreeBackend Backend = EOctreeBackend::Pointer;
 
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
 	FName OctreeIgnoreTag;
@@ -85,6 +201,18 @@ private:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
 	TArray<AActor*> ActorsToIgnore;
 
+	//Actors with this tag or an activatable object are followed as they move, instead of being taken as a box at setup. Pointer backend only.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", EditCondition = "Backend == EOctreeBackend::Pointer"))
+	FName OctreeDynamicTag;
+
+	//Dynamic actors whose bounds moved less than this keep their old box, so something that only wobbles does not reclassify leaves every frame.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0, EditCondition = "Backend == EOctreeBackend::Pointer"))
+	float DynamicObstacleTolerance = 10;
+
+	//Seconds obstacle changes wait for a moment without searches. After that, the next search waits for the running ones and applies them.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0, EditCondition = "Backend == EOctreeBackend::Pointer"))
+	float ObstacleUpdateMaxDelay = 0.1f;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
 	TEnumAsByte<ECollisionChannel> CollisionChannel = ECC_WorldStatic;
 
@@ -96,6 +224,95 @@ private:
 
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1))
 	float MinNodeSize = 100;
+
+	//Lazy Theta*. Paths come out smooth from the worker threads, using the octree for line of sight instead of physics sweeps.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
+	bool UseAnyAnglePaths = true;
+
+	//Without any-angle paths, the path of leaves is pulled tight through the faces they share on the worker threads, also instead of physics sweeps.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", EditCondition = "!UseAnyAnglePaths"))
+	bool UseFunnelPaths = true;
+
+	//Starts and ends inside the geometry, or just outside the octree, are moved to the nearest free leaf within this distance before searching.
+	//Without it, a start or end in an occupied leaf with no free sibling leads to a search that can only fail. 0 to turn it off.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0))
+	float SnapRadius = 500;
+
+	//Kept clear around the line of sight of any-angle paths, and from the edges of the faces of funnel paths. Should be about the radius of the agents using this octree.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0, EditCondition = "UseAnyAnglePaths || UseFunnelPaths"))
+	float AgentRadius = 50;
+
+	//Agents keep their last search tree and continue it while they move through the leaves it expanded, instead of searching again every time
+	//the target moves.
+	//Whichever worker takes the query, the tree is the agent's own.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
+	bool UseIncrementalSearch = true;
+
+	//Agents that keep a search tree at once. Past it, the agent that searched least recently loses its tree to the next one.
+	//On the linear backend every tree costs about 16 bytes per cell of the octree.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1, EditCondition = "UseIncrementalSearch"))
+	int32 MaxAgentSearchTrees = 16;
+
+	//Seconds a single query may search for. Longer searches return a partial path, and carry on with the next query if the search is incremental.
+	//A partial path only goes through leaves the tree expanded, so an agent following it keeps its tree. Without incremental search,
+	//every query starts over and a long path may never be found within a small budget.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0.001))
+	float SearchTimeBudget = 0.01f;
+
+	//Same as the time budget, in expanded nodes. Independent of the machine, 0 for no limit.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0))
+	int32 SearchExpansionBudget = 0;
+
+	//Higher weights find a path faster, but it can be longer than needed. 1 is plain A*.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1))
+	float HeuristicWeight = 3.0f;
+
+	//Hand the agent the first path found with HeuristicWeight right away, then keep improving it with lower weights while the search has budget.
+	//Every shorter path goes to the agent as soon as it is found.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true"))
+	bool UseAnytimeSearch = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1, EditCondition = "UseAnytimeSearch"))
+	float FinalHeuristicWeight = 1.0f;
+
+	//How much the weight goes down for every improved path.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0.01, EditCondition = "UseAnytimeSearch"))
+	float HeuristicWeightStep = 0.5f;
+
+	//Linear backend only. Long paths are first searched over clusters of nodes, then refined inside the clusters the path goes through.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", EditCondition = "Backend == EOctreeBackend::Linear"))
+	bool UseHierarchicalSearch = true;
+
+	//Levels between the leaves and the clusters of the hierarchical search. Bigger clusters make the coarse search cheaper and the refining one more expensive.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1, ClampMax = 8,
+		EditCondition = "Backend == EOctreeBackend::Linear && UseHierarchicalSearch"))
+	int32 HierarchyClusterLevels = 3;
+
+	//Linear backend only. Labels the parts of the free space that are connected once the octree is built or loaded, so a search toward a
+	//target the agent cannot reach fails right away instead of flooding everything it can reach. The pointer backend instead remembers
+	//the parts that failed searches flooded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", EditCondition = "Backend == EOctreeBackend::Linear"))
+	bool LabelFreeSpaceComponents = true;
+
+	//Linear backend only. The agents follow one flow field toward their target instead of each searching their own path.
+	//Pays off with many agents chasing the same target, the field costs about as much as a single search across the whole octree.
+	//The field serves a single target shared by every agent of the octree, the one set last. Agents outside the field (not connected
+	//to the target, before the first field is done, or chasing a target in another leaf) still search their own path.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", EditCondition = "Backend == EOctreeBackend::Linear"))
+	bool UseFlowField = false;
+
+	//Megabytes of nodes and search data the pointer backend may keep. Over it, the least recently used parts of the tree are freed
+	//a little after every search, and divided again when they are needed. 0 for no limit.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0, EditCondition = "Backend == EOctreeBackend::Pointer"))
+	float NodeMemoryBudget = 64;
+
+	//Milliseconds a search may spend freeing nodes after it is done.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 0.01, EditCondition = "Backend == EOctreeBackend::Pointer"))
+	float EvictionTimeBudget = 0.2f;
+
+	//Threads of the world's pathfinding service, shared by every octree in the world. The pool grows to the most any octree asks for.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1, ClampMax = 16))
+	int32 PathfindingWorkerCount = 1;
 	
 	// The number of divisions in the grid along the X axis
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Octree", meta = (AllowPrivateAccess = "true", ClampMin = 1))
@@ -111,6 +328,15 @@ private:
 	int32 ExpandVolumeZAxis = 1;
 
 	void SetUpOctree();
+
+	//An arena with the root node, which has the expand volumes as its children if the objects are not auto encapsulated.
+	TSharedPtr<FOctreeNodeArena> MakeNodeArena() const;
+	FOctreePathSettings GetPathSettings() const;
+	//With OutDynamicActors, the dynamic actors go there instead of into the boxes.
+	void CollectActorBoxes(TArray<FBox>& OutBoxes, TArray<AActor*>* OutDynamicActors = nullptr) const;
+	bool IsDynamicObstacle(const AActor* Actor) const;
+	//The box covered by all the expand volumes together.
+	FBox GetVolumeBounds() const;
 	bool Loading = false;
 
 	std::atomic<bool> IsSetup = false;
@@ -119,5 +345,19 @@ private:
 
 	FVector PreviousNextLocation = FVector::ZeroVector;
 	
-	TSharedPtr<FPathfindingWorker> PathfindingWorker;
+	//Shared with the requests in flight, so it stays valid until their searches are done.
+	TSharedPtr<FOctreeSearchGraph> SearchGraph;
+	//Refreshes the flow field, if there is one.
+	TSharedPtr<FPathfindingWorker> FlowFieldWorker;
+
+	//The obstacle of every dynamic actor, with the bounds it was last given.
+	struct FDynamicObstacle
+	{
+		int32 Id = INDEX_NONE;
+		FBox Bounds = FBox(ForceInit);
+	};
+	TMap<TWeakObjectPtr<AActor>, FDynamicObstacle> DynamicObstacles;
+
+	//Gives the graph its settings and makes sure the world's service has enough workers.
+	void RegisterSearchGraph(const TSharedPtr<FOctreeSearchGraph>& Graph);
 };
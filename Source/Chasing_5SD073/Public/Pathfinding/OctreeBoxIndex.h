@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/* Uniform grid over the level boxes the octree is built from.
+ *
+ * Every box is registered in the cells it overlaps, so an occupancy test only looks at the boxes around the node instead of every box in the level.
+ * The cells are stored back to back in one array (CellStarts tells where each cell begins), which keeps the whole index in two allocations.
+ * Boxes that would cover a lot of cells (floors, walls of the whole level) are kept aside and checked for every query instead.
+ *
+ * The index is immutable after Build(), so it can be read from any thread. The only exception are the dynamic boxes: a few boxes of
+ * things that move, kept aside like the large ones. Whoever changes them has to make sure nothing reads the index at the same time.
+ */
+class CHASING_5SD073_API FOctreeBoxIndex
+{
+public:
+	enum class EOverlap : uint8
+	{
+		None,
+		Intersects,
+		//Completely inside at least one box.
+		Inside
+	};
+
+	FOctreeBoxIndex() = default;
+	explicit FOctreeBoxIndex(const TArray<FBox>& InBoxes) { Build(InBoxes); }
+
+	void Build(const TArray<FBox>& InBoxes);
+
+	//Same result as testing NodeBox.Intersect(Box) and Box.IsInside(NodeBox) against every box.
+	EOverlap Classify(const FBox& NodeBox) const;
+
+	//True if the segment, grown by the radius, touches none of the boxes. The segment is walked a cell at a time, so only the boxes along it are tested.
+	bool IsSegmentClear(const FVector& From, const FVector& To, const float Radius = 0) const;
+
+	//Same walk as IsSegmentClear(), but finds the first box the segment hits, at the fraction OutTime of it. False if it hits none.
+	bool Raycast(const FVector& From, const FVector& To, const float Radius, float& OutTime, FBox& OutBox) const;
+
+	//Adds the dynamic box with the given id, or moves it if there is one already.
+	void SetDynamicBox(const int32 Id, const FBox& Box);
+	void RemoveDynamicBox(const int32 Id);
+	const FBox* FindDynamicBox(const int32 Id) const { return DynamicBoxes.Find(Id); }
+
+	const TArray<FBox>& GetBoxes() const { return Boxes; }
+	int32 Num() const { return Boxes.Num(); }
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	//Inclusive range of cells the box touches, clamped to the grid. Returns false if it is completely outside.
+	bool GetCellRange(const FBox& Box, FIntVector& OutMin, FIntVector& OutMax) const;
+	int32 GetCellIndex(const int32 X, const int32 Y, const int32 Z) const { return (Z * GridSize.Y + Y) * GridSize.X + X; }
+
+	TArray<FBox> Boxes;
+	TArray<int32> LargeBoxes;
+	TMap<int32, FBox> DynamicBoxes;
+
+	//Boxes of cell i are CellBoxes[CellStarts[i]] to CellBoxes[CellStarts[i + 1] - 1].
+	TArray<int32> CellStarts;
+	TArray<int32> CellBoxes;
+
+	FBox GridBounds = FBox(ForceInit);
+	FIntVector GridSize = FIntVector::ZeroValue;
+	double CellSize = 1;
+};
@@ -3,32 +3,266 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "LinearOctree.h"
+#include "LinearOctreeHierarchy.h"
 #include "OctreeNode.h"
+#include "OctreeNodeArena.h"
+
+//How paths are searched, the same for both backends.
+struct FOctreePathSettings
+{
+	//Lazy Theta*: a node can take any node it has line of sight to as its parent, not only its neighbors, so the path comes out smooth
+	//and does not need to be swept on the game thread.
+	bool AnyAngle = false;
+
+	//Kept clear around every line of sight, roughly the radius of the agents.
+	float AgentRadius = 0;
+
+	//Without AnyAngle, the path of cells is pulled tight through the faces the cells share (a 3D funnel), instead of going through
+	//their centers. It comes out as straight as the corridor allows, kept AgentRadius away from the edges of the faces.
+	bool Funnel = false;
+
+	//A start or end inside the geometry (in an occupied leaf with no free sibling) or just outside the octree is moved to the closest
+	//point of the nearest free leaf within this distance. 0 to leave them where they are.
+	float SnapRadius = 0;
+
+	//Incremental replanning: the search tree is kept between queries, and a query from a leaf the tree expanded carries on with it toward
+	//the new end instead of searching again. A start that moved is made the root of the tree first, the paths from it then follow the
+	//old tree and are not always the shortest. Pays off when both ends move a little between queries, like a chase.
+	bool Incremental = false;
+
+	//Time slicing. A search that runs out of either budget returns the path to the expanded node closest to the end, a partial path.
+	//With Incremental set, the next query from a leaf of the tree carries on from there, so a long search is spread over several calls.
+	float TimeBudget = 1.0f;
+	//0 for no limit.
+	int32 ExpansionBudget = 0;
+
+	//How much the heuristic is inflated. Higher finds a path faster, but a longer one.
+	float HeuristicWeight = 3.0f;
+
+	//Anytime search (ARA*): the first path is searched with HeuristicWeight and returned as soon as it is found. The weight is then
+	//lowered by HeuristicWeightStep, down to FinalHeuristicWeight, and with Incremental set every later query toward the same end leaf
+	//improves the path once more. One that runs out of budget meanwhile returns the best path so far.
+	bool Anytime = false;
+	float FinalHeuristicWeight = 1.0f;
+	float HeuristicWeightStep = 0.5f;
+
+	//Anytime only. Every path found before the final weight is handed to it from the searching thread, and the same search goes on
+	//with the next weight while it has budget, handing out each shorter path. It returns the best path once the weight is final
+	//or the budget is spent. Without it, the first path is returned right away.
+	TFunction<void(TConstArrayView<FVector>)> OnPathImproved;
+};
+
+//Per agent scratch memory for LinearOctreeAStar. Sized to the cell count once and reused, the stamps tell which entries belong to the current search.
+struct FLinearOctreeSearchScratch
+{
+	struct FOpenEntry
+	{
+		float F;
+		uint32 Node;
+
+		bool operator<(const FOpenEntry& Other) const { return F < Other.F; }
+	};
+
+	TArray<float> G;
+	TArray<uint32> CameFrom;
+	TArray<uint32> OpenStamp;
+	TArray<uint32> ClosedStamp;
+	TArray<FOpenEntry> OpenHeap;
+	TArray<uint32> Neighbors;
+	uint32 Stamp = 0;
+
+	//Faces along the path and the points on them, for FOctreePathSettings::Funnel.
+	TArray<FBox> Portals;
+	TArray<FVector> PortalPoints;
+
+	//Closed cells are the ones with the close stamp of the current weight. Anytime searches bump it for every weight, the tree started
+	//at TreeCloseStamp, so a cell closed at or after it was expanded by this tree.
+	uint32 CloseStamp = 0;
+	uint32 TreeCloseStamp = 0;
+	float Weight = 1.0f;
+	//Closed cells that got cheaper, expanded again with the next weight. Can hold the same cell twice, the heap skips the second one.
+	TArray<uint32> Inconsistent;
+
+	//Same as above, per cluster, for the coarse part of HierarchicalLinearOctreeAStar.
+	TArray<float> CoarseG;
+	TArray<uint32> CoarseCameFrom;
+	TArray<uint32> CoarseOpenStamp;
+	TArray<uint32> CoarseClosedStamp;
+	//Clusters the refining search may enter are marked with the coarse stamp.
+	TArray<uint32> CorridorStamp;
+	TArray<FOpenEntry> CoarseHeap;
+	TArray<uint32> CoarsePath;
+	uint32 CoarseStamp = 0;
+
+	//Tree kept for incremental replanning, see FOctreePathSettings::Incremental.
+	bool HasTree = false;
+	uint32 TreeStart = LinearOctree::InvalidIndex;
+	uint32 TreeEnd = LinearOctree::InvalidIndex;
+	//Cells whose G is measured again when the tree is rerooted.
+	TArray<uint32> Chain;
+
+	//Starts a new tree. The arrays must be sized to the octree already.
+	void BeginSearch();
+	//Starts a new weight of an anytime search, with an empty closed set.
+	void BeginIteration();
+
+	bool IsClosed(const uint32 Cell) const { return ClosedStamp[Cell] == CloseStamp; }
+	bool WasExpanded(const uint32 Cell) const { return OpenStamp[Cell] == Stamp && ClosedStamp[Cell] >= TreeCloseStamp; }
+};
+
+/* Per query state of LazyOctreeAStar, one per agent.
+ *
+ * Nothing about a search is stored in the tree. Every node with search data has a slot (FPathfindingNode::Slot), and this context keeps
+ * its G, F and parent for that slot in its own records. That is what lets several searches run on one octree at the same time.
+ * The visited and closed flags are the stamp of the search, so a new search does not reset anything, and the arrays keep their
+ * capacity, so once warm a search does not allocate.
+ */
+struct FLazyOctreeSearchContext
+{
+	struct FSearchRecord
+	{
+		OctreeNode* Node;
+		//Record index of the node we came from, INDEX_NONE for the start.
+		int32 CameFrom;
+		float G;
+		float F;
+		uint32 VisitedStamp;
+		uint32 ClosedStamp;
+		//Position in the open heap, INDEX_NONE if not in it, InconsistentIndex if it is waiting for the next weight.
+		int32 HeapIndex;
+	};
+
+	static constexpr int32 InconsistentIndex = -2;
+
+	TArray<FSearchRecord> Records;
+
+	//4-ary min heap of record indices on F. Every record knows its own heap index, which is what makes decrease-key possible.
+	TArray<int32> OpenHeap;
+
+	//Same as in FLinearOctreeSearchScratch, closed for the current weight of an anytime search, and expanded by the tree at all.
+	uint32 CloseStamp = 0;
+	uint32 TreeCloseStamp = 0;
+	float Weight = 1.0f;
+	//Closed records that got cheaper, expanded again with the next weight.
+	TArray<int32> Inconsistent;
+
+	TArray<OctreeNode*> FaceLeaves;
+	//Neighbors of the node being expanded, copied out of the tree so the search can walk them without holding the divide lock.
+	TArray<OctreeNode*> Neighbors;
+	uint32 Stamp = 0;
+
+	//Same as in FLinearOctreeSearchScratch.
+	TArray<FBox> Portals;
+	TArray<FVector> PortalPoints;
+
+	//Tree kept for incremental replanning, see FOctreePathSettings::Incremental. Only valid as long as the arena is at the same revision
+	//and nothing of it was evicted.
+	bool HasTree = false;
+	FOctreeNodeHandle TreeStart;
+	FOctreeNodeHandle TreeEnd;
+	uint32 TreeRevision = 0;
+	//Same as in FLinearOctreeSearchScratch.
+	TArray<int32> Chain;
+
+	//Epoch of the current search, and the one the kept tree was started at. Every node of the tree is stamped at or after it,
+	//so a search that carries on the tree enters that epoch instead. See FOctreeNodeArena.
+	uint64 Epoch = 0;
+	uint64 TreeEpoch = 0;
+
+	//Stamps a node the search got, so eviction keeps it until the search is done. Must hold the arena's divide lock.
+	void MarkInUse(OctreeNode* Node) const { Node->LastEpoch = FMath::Max(Node->LastEpoch, Epoch); }
+
+	//The node must have search data. Grows the records if the node's slot is new to this context.
+	int32 GetRecordIndex(const OctreeNode* Node);
+
+	//True if the current search reached the node.
+	bool WasReached(const OctreeNode* Node) const;
+
+	//Bumps the stamp, which makes every record belong to an older search.
+	void BeginSearch();
+	//Starts a new weight of an anytime search, with an empty closed set.
+	void BeginIteration();
+
+	bool IsClosed(const FSearchRecord& Record) const { return Record.ClosedStamp == CloseStamp; }
+	bool WasExpanded(const FSearchRecord& Record) const { return Record.VisitedStamp == Stamp && Record.ClosedStamp >= TreeCloseStamp; }
+
+	void HeapPush(const int32 RecordIndex);
+	int32 HeapPop();
+	//Call after lowering the F of a record that is in the heap.
+	void HeapDecreaseKey(const int32 RecordIndex);
+	//Restores the heap after the F of any number of records changed.
+	void Heapify();
+	//Moves the inconsistent records into the heap, without restoring it.
+	void OpenInconsistent();
+
+private:
+	static constexpr int32 HeapArity = 4;
+	//Records grow a pathfinding data slab at a time, see FOctreeNodeArena.
+	static constexpr int32 RecordGrowth = 1024;
+
+	void SiftUp(int32 Index);
+	void SiftDown(int32 Index);
+};
 
 class CHASING_5SD073_API OctreeGraph
 {
 public:
 	OctreeGraph();
 	~OctreeGraph();
-	
-	static bool LazyOctreeAStar(const bool& ThreadIsPaused, const bool& Debug, const TArray<FBox>& ActorBoxes, const float& MinSize, const FVector& StartLocation, const FVector& EndLocation, const TSharedPtr<OctreeNode>& RootNode, TArray<FVector>& OutPathList);
-	
-	static FVector DirectionTowardsSharedFaceFromSmallerNode(const TSharedPtr<OctreeNode>& Node1, const TSharedPtr<OctreeNode>& Node2);
-	static float ManhattanDistance(const TSharedPtr<OctreeNode>& From, const TSharedPtr<OctreeNode>& To);
-	static void ReconstructPath(const TSharedPtr<OctreeNode>& Start, const TSharedPtr<OctreeNode>& End, TArray<FVector>& OutPathList);
+
+	//Safe to run on several threads against the same arena, as long as every thread has its own context.
+	//With incremental settings, a query from a node the previous one expanded continues its search tree (moving target A*).
+	//The G of every node in the tree is its distance from the start along the tree, so the open nodes only need the new heuristic.
+	static bool LazyOctreeAStar(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, const FVector& StartLocation, const FVector& EndLocation, FOctreeNodeArena& Arena, FLazyOctreeSearchContext& Context, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings = FOctreePathSettings());
+
+	//Same search as LazyOctreeAStar, but on the read-only linear octree.
+	static bool LinearOctreeAStar(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FLinearOctree& Octree, FLinearOctreeSearchScratch& Scratch, const FVector& StartLocation, const FVector& EndLocation, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings = FOctreePathSettings());
+
+	//Searches the clusters of the hierarchy first, then refines the path only inside the clusters it went through.
+	//If the corridor turns out to be blocked (a cluster can be split in parts that are not connected), it is widened by the clusters next to it,
+	//and as a last resort the whole octree is searched.
+	static bool HierarchicalLinearOctreeAStar(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FLinearOctreeHierarchy& Hierarchy, FLinearOctreeSearchScratch& Scratch, const FVector& StartLocation, const FVector& EndLocation, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings = FOctreePathSettings());
+
+	static FVector DirectionTowardsSharedFaceFromSmallerNode(const OctreeNode* Node1, const OctreeNode* Node2);
+	static FVector DirectionTowardsSharedFaceFromSmallerNode(const FVector& Center1, const float HalfSize1, const FVector& Center2, const float HalfSize2);
+	static float ManhattanDistance(const OctreeNode* From, const OctreeNode* To);
+	//Without buffer points, the parents of an any-angle search are already in line of sight of each other.
+	static void ReconstructPath(const FLazyOctreeSearchContext& Context, const int32 StartIndex, const int32 EndIndex, const bool AddBufferPoints, TArray<FVector>& OutPathList);
+
+	//The face two neighboring cells share, shrunk by the radius along it. Flat on the axis the cells are next to each other on.
+	static FBox GetPortal(const FBox& From, const FBox& To, const float Radius);
+
+	//Shortest path from start to end that goes through every portal in order, for a path of cells that is the shortest path inside them.
+	//Appends only the corners, the points where the path bends, not the end. Points is scratch memory.
+	static void PullString(const FVector& Start, const FVector& End, const TArray<FBox>& Portals, TArray<FVector>& Points, TArray<FVector>& OutPathList);
 
 	//Checks if we have all the possible neighbors, if not, it will create them or find them. Returns true if successful, false otherwise.
-	static bool GetNeighbors(const bool& ThreadIsPaused, const TSharedPtr<OctreeNode>& RootNode, const TSharedPtr<OctreeNode>& CurrentNode, const TArray<FBox>& ActorBoxes,  const float& MinSize);
+	//FaceLeaves is scratch memory, passed in so it keeps its capacity between calls.
+	static bool GetNeighbors(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, OctreeNode* CurrentNode, const FOctreeBoxIndex& ActorBoxes,  const float& MinSize, TArray<OctreeNode*>& FaceLeaves);
+
+	//Appends up to Count free leaves, nearest to the location first, none further than MaxRadius from it. Same best first walk as
+	//FLinearOctree::FindNearestFreeCells(), dividing the occupied nodes it opens. Must hold the arena's divide lock.
+	static void FindNearestFreeLeaves(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, const FVector& Location, const float MaxRadius, const int32 Count, TArray<OctreeNode*>& OutLeaves);
+
+	//The point of the leaf closest to the location, kept a little inside so it is not on the face the leaf shares with an occupied one.
+	static FVector SnapIntoLeaf(const FBox& LeafBox, const FVector& Location);
+
+	//The same or larger node on the other side of the face, dividing on the way like LazyDivideAndFindNode() would. Null at the border of the octree.
+	static OctreeNode* FindFaceNeighbor(FOctreeNodeArena& Arena, const OctreeNode* Node, const int Face, const FOctreeBoxIndex& ActorBoxes, const float& MinSize);
+
+	//Appends the free leaves of the subtree that touch the face (seen from the node on the other side). Divides the occupied ones on the way.
+	static void GatherFaceLeaves(FOctreeNodeArena& Arena, OctreeNode* Node, const int Face, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, TArray<OctreeNode*>& OutLeaves);
 	
 	static TArray<double> TimeTaken;
 
-	static TArray<FVector> CalculatePositions(const TSharedPtr<OctreeNode>& CurrentNode, const int& Face, const float& MinNodeSize);
-
-	static void CleanupUnusedNodes(TSharedPtr<OctreeNode>& Node, const TSet<TSharedPtr<OctreeNode>>& OpenSet, int& DeletedChildrenCount);
+	//Classifies the leaves below the node that touch the region again, the way DivideAndClassify() does, and appends the ones that changed.
+	//Divided nodes stay occupied, that is what keeps them divided. Must hold the arena's occupancy lock for writing.
+	static void ReclassifyLeaves(OctreeNode& Node, const FBox& Region, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, TArray<OctreeNode*>& OutChanged);
 
-	inline static constexpr int MemoryOptimizerTickThreshold = 10;
-	inline static constexpr int MemoryCleanupFrequency = 50;
-	inline static int PathfindingMemoryTick = 0;
+	//Makes the nodes touching the region look for their neighbors again. Handles to recycled leaves go stale on their own,
+	//this is for the leaves that became free, which their neighbors never knew about.
+	static void InvalidateNeighbors(OctreeNode& Node, const FBox& Region);
 
 private: 	
 	inline static FIntVector DIRECTIONS[6] = {
@@ -40,19 +274,34 @@ private:
 		FIntVector(0, 0, 1)    // Top face
 	};
 
-	static TWeakPtr<OctreeNode> PreviousValidStart;
-	static TWeakPtr<OctreeNode> PreviousValidEnd;
-	
-};
+	//The search itself, LazyOctreeAStar() wraps it in the arena's locks.
+	static bool FindLazyOctreePath(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, const FVector& StartLocation, const FVector& EndLocation, FOctreeNodeArena& Arena, FLazyOctreeSearchContext& Context, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings);
 
-struct FPathfindingNodeCompare
-{
-	//Will put the lowest FScore above all
-	bool operator()(const TSharedPtr<OctreeNode>& Node1, const TSharedPtr<OctreeNode>& Node2) const
-	{
-		return (Node1->PathfindingData->F > Node2->PathfindingData->F);
-		//I read somewhere that prioritizing also with lower H scores can help with the performance of the A* algorithm.
-		//as in Node1->PathfindingData->F > Node2->PathfindingData->F && Node1->PathfindingData->H > Node2->PathfindingData->H
-		//untested though
-	}
+	//The linear search, only entering the clusters marked in Scratch.CorridorStamp if a hierarchy is given.
+	static bool FindLinearOctreePath(const std::atomic<bool>& ThreadIsPaused, const bool& Debug, const FLinearOctree& Octree, const FLinearOctreeHierarchy* Corridor, FLinearOctreeSearchScratch& Scratch, const FVector& StartLocation, const FVector& EndLocation, TArray<FVector>& OutPathList, const FOctreePathSettings& Settings);
+
+	//False if the labelled components of the octree tell that no path connects the cells. An occupied cell is in the components of its
+	//free neighbors. Neighbors is scratch memory.
+	static bool MayBeConnected(const FLinearOctree& Octree, const uint32 Start, const uint32 End, TArray<uint32>& Neighbors);
+
+	//True if an earlier search from the start's component flooded it completely without reaching the end. Must hold the arena's divide lock.
+	static bool IsKnownUnreachable(const FOctreeNodeArena& Arena, OctreeNode* Start, OctreeNode* End);
+
+	//Keeps every leaf the search reached as a flooded component, after it ran out of nodes without reaching the end. Unless there are
+	//more than FOctreeNodeArena::MaxFloodedLeaves of them.
+	static void RememberFloodedComponent(FOctreeNodeArena& Arena, const FLazyOctreeSearchContext& Context, OctreeNode* End);
+
+	//For a cell outside the octree or occupied, the closest point of the nearest free cell within the radius. False if the location stays.
+	static bool SnapToFreeCell(const FLinearOctree& Octree, const uint32 Cell, const FVector& Location, const float Radius, FVector& OutLocation);
+
+	//Fills Scratch.CoarsePath with the clusters from the start to the end cluster, end first.
+	static bool FindCoarsePath(const std::atomic<bool>& ThreadIsPaused, const FLinearOctreeHierarchy& Hierarchy, FLinearOctreeSearchScratch& Scratch, const uint32 StartCluster, const uint32 EndCluster);
+
+	//Finds the neighbors of the node under the divide lock and copies them into the context.
+	static bool CollectNeighbors(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, OctreeNode* Node, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, FLazyOctreeSearchContext& Context);
+
+	//Adds the time to TimeTaken and returns the average. Searches on different threads share it.
+	static double AddTimeTaken(const double Time);
+
+	static FCriticalSection TimeTakenLock;
 };
@@ -4,52 +4,78 @@
 
 
 #include "CoreMinimal.h"
+#include "OctreeBoxIndex.h"
 
+class FOctreeNodeArena;
 struct FPathfindingNode;
 
 LLM_DECLARE_TAG(OctreeNode);
 
+//Nodes are owned by the FOctreeNodeArena of their octree, which also hands out their children and search data.
 class CHASING_5SD073_API OctreeNode
 {
 public:
 	OctreeNode(const FVector& Pos, const float HalfSize);
 	OctreeNode();
-	~OctreeNode();
 
 	FVector Position;
 	float HalfSize;
-	
+
 	bool IsDivisible = true;
 	bool Occupied = false;
 
-	int MemoryOptimizerTick = 0;
-	bool NodeIsInUse = false;
-	
-	//TSet<TWeakPtr<OctreeNode>> Neighbors;
-	TArray<TSharedPtr<OctreeNode>> ChildrenOctreeNodes;
-	TSharedPtr<FPathfindingNode> PathfindingData = nullptr;
-	
+	//Latest epoch of the searches that got the node. Eviction keeps it while one of them runs, and frees the oldest first. See FOctreeNodeArena.
+	uint64 LastEpoch = 0;
+
+	//Bumped by the arena every time the node is freed or recycled, so old handles to it can tell.
+	uint32 Generation = 0;
+
+	//Contiguous, 8 of them for every node but the root.
+	OctreeNode* Children = nullptr;
+	int32 ChildCount = 0;
+
+	FPathfindingNode* PathfindingData = nullptr;
+
+	TArrayView<OctreeNode> GetChildren() const { return TArrayView<OctreeNode>(Children, ChildCount); }
+	bool HasChildren() const { return ChildCount > 0; }
+
 	bool IsInsideNode(const FVector& Location) const;
-	TSharedPtr<OctreeNode> LazyDivideAndFindNode(const bool& ThreadIsPaused, const TArray<FBox>& ActorBoxes, const float& MinSize, const FVector& Location, const bool LookingForNeighbor);
-	TSharedPtr<OctreeNode> MakeChild(const int& ChildIndex) const;
-	static void DeleteOctreeNode(TSharedPtr<OctreeNode>& Node);
+	OctreeNode* LazyDivideAndFindNode(const std::atomic<bool>& ThreadIsPaused, FOctreeNodeArena& Arena, const FOctreeBoxIndex& ActorBoxes, const float& MinSize, const FVector& Location, const bool LookingForNeighbor);
+	void MakeChild(const int& ChildIndex, OctreeNode& OutChild) const;
+
+	//Gives the node its 8 children and marks the ones touching a box as occupied.
+	void DivideAndClassify(FOctreeNodeArena& Arena, const FOctreeBoxIndex& ActorBoxes, const float& MinSize);
 };
 
+//Weak reference to a node of an arena. The memory of a freed node stays valid until the arena goes away, so checking the generation is enough.
+struct CHASING_5SD073_API FOctreeNodeHandle
+{
+	OctreeNode* Node = nullptr;
+	uint32 Generation = 0;
+
+	FOctreeNodeHandle() = default;
+	FOctreeNodeHandle(OctreeNode* InNode) : Node(InNode), Generation(InNode ? InNode->Generation : 0) {}
 
+	bool IsValid() const { return Node != nullptr && Node->Generation == Generation; }
+	OctreeNode* Get() const { return IsValid() ? Node : nullptr; }
+	void Reset() { Node = nullptr; }
+
+	bool operator==(const FOctreeNodeHandle& Other) const { return Node == Other.Node && Generation == Other.Generation; }
+	friend uint32 GetTypeHash(const FOctreeNodeHandle& Handle) { return HashCombine(GetTypeHash(Handle.Node), Handle.Generation); }
+};
+
+
+//Search independent data of a node, shared by every search on the octree. What a single search knows about a node lives in its search context.
 struct CHASING_5SD073_API FPathfindingNode
 {
-	float F;
-	float G;
-	float H;
-	TWeakPtr<OctreeNode> CameFrom;
-	TSet<TWeakPtr<OctreeNode>> Neighbors;
-	
-	FPathfindingNode()
-	{
-		F = FLT_MAX;
-		G = FLT_MAX;
-		H = FLT_MAX;
-		CameFrom = nullptr;
-	}
-};
+	TSet<FOctreeNodeHandle> Neighbors;
+
+	//Same or larger node on the other side of each face, in the order of OctreeGraph's DIRECTIONS. The smaller neighbors are below it.
+	FOctreeNodeHandle FaceLinks[6];
 
+	//Set once Neighbors holds every free leaf around the node. Cleared when one of them goes stale.
+	bool NeighborsComplete = false;
+
+	//Index of this data in its arena, set once when the arena allocates it. Search contexts keep their per node records at this index.
+	int32 Slot = INDEX_NONE;
+};
@@ -0,0 +1,177 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "OctreeNode.h"
+
+/* Owns every OctreeNode and FPathfindingNode of one octree.
+ *
+ * Children are always allocated 8 at a time (a brood), out of slabs of broods. Freed broods and search data go back to free lists and are
+ * handed out again, so once the slabs are warm, dividing and searching don't touch the general heap. Slabs are only given back when the
+ * arena is destroyed, which frees the whole tree at once.
+ *
+ * A freed node stays readable, only its generation changes. That is what FOctreeNodeHandle checks.
+ * All slabs are allocated under the OctreeNode LLM tag.
+ *
+ * The arena does no locking of its own. Searches that share it hold OccupancyLock for reading and DivideLock while they divide or
+ * look up neighbors, and only obstacle updates take OccupancyLock for writing.
+ *
+ * Eviction runs next to the searches, under DivideLock only. Every search enters an epoch and stamps each node it gets with it
+ * (OctreeNode::LastEpoch), always under DivideLock. Eviction only frees the nodes stamped before the oldest epoch still running, so a
+ * search never has a node freed under it and reads the tree without any reference counting.
+ *
+ * The stamps double as the recency of the nodes. Once the nodes and search data in use go over MemoryBudget, EvictOverBudget() frees
+ * the broods of leaves least recently used first, a little after every search, so the arena's size stays flat and no search stalls on it.
+ */
+class CHASING_5SD073_API FOctreeNodeArena
+{
+public:
+	FOctreeNodeArena(const FVector& RootPosition, const float RootHalfSize);
+	~FOctreeNodeArena();
+
+	FOctreeNodeArena(const FOctreeNodeArena&) = delete;
+	FOctreeNodeArena& operator=(const FOctreeNodeArena&) = delete;
+
+	OctreeNode* GetRoot() { return &Root; }
+	const OctreeNode* GetRoot() const { return &Root; }
+
+	//Gives a leaf its 8 children, positioned by OctreeNode::MakeChild().
+	void Divide(OctreeNode& Node);
+
+	//Gives a leaf any number of children in a block of their own. Meant for the root's expand volumes, the block lives as long as the arena.
+	TArrayView<OctreeNode> DivideCustom(OctreeNode& Node, const int32 Count);
+
+	//Frees everything below the node. The node itself becomes a leaf again, unless its children are a custom block.
+	void FreeChildren(OctreeNode& Node);
+
+	//Frees the search data of a leaf and invalidates all handles to it, so it gets found again as if it was new.
+	void RecycleNode(OctreeNode& Node);
+
+	FPathfindingNode& GetOrAddPathfindingData(OctreeNode& Node);
+	void FreePathfindingData(OctreeNode& Node);
+
+	int32 NumNodes() const { return LiveNodeCount; }
+	int32 NumPathfindingData() const { return LivePathfindingDataCount; }
+
+	//Nodes, search data and flooded components in use, what MemoryBudget is measured against. Not counting what the neighbor sets
+	//allocate on their own. Must hold DivideLock.
+	SIZE_T GetUsedSize() const;
+
+	//Slabs and blocks, whether they are in use or not.
+	SIZE_T GetAllocatedSize() const;
+
+	//Held while the tree or the neighbor sets change, which searches do as they go.
+	FCriticalSection DivideLock;
+
+	//Searches hold it for reading the whole time. Obstacle updates need it for writing, they change the occupancy of nodes
+	//that searches read without the divide lock.
+	FRWLock OccupancyLock;
+
+	//Bumped by every obstacle update. Search trees and flooded components kept from before it are on the old occupancy.
+	std::atomic<uint32> Revision = 0;
+
+	//Bytes of GetUsedSize() eviction keeps the arena under, 0 for no limit. Seconds a single EvictOverBudget() may take.
+	SIZE_T MemoryBudget = 0;
+	double EvictionTimeBudget = 0.0002;
+
+	//Latest epoch of the nodes evicted so far. A search tree started after it has all of its nodes still.
+	std::atomic<uint64> EvictedEpoch = 0;
+
+	//A new epoch for a search, later than every one handed out before.
+	uint64 NewEpoch() { return NextEpoch++; }
+	//Registers a running search at the epoch, which may be older than its own if it carries on a kept tree. Returns the reader
+	//slot for LeaveEpoch(). With more searches than slots at once, the extra ones wait for a slot.
+	int32 EnterEpoch(const uint64 Epoch);
+	void LeaveEpoch(const int32 Reader) { ReaderEpochs[Reader] = 0; }
+	//Oldest epoch of the running searches, MAX_uint64 if there are none. Nodes stamped before it are not held by any search.
+	//Must hold DivideLock, so no search stamps a node meanwhile.
+	uint64 GetOldestEpoch() const;
+
+	//While over MemoryBudget, frees the broods of leaves that were used least recently and by none of the running searches, for at
+	//most EvictionTimeBudget. Picks up where the last call stopped. Returns the number of nodes freed. Must hold DivideLock.
+	int32 EvictOverBudget();
+
+	//Free space that a search flooded completely without reaching its end, the negative cache of OctreeGraph::IsKnownUnreachable().
+	//Under DivideLock. Only valid at the revision it was found at. Eviction drops the components of the leaves it frees, the leaves
+	//divided again in their place would be missing from the set, which reads as unreachable.
+	struct FFloodedComponent
+	{
+		TSet<FOctreeNodeHandle> Leaves;
+		//The end it did not reach. Occupied ends are not part of any component, so those are only known by themselves.
+		FOctreeNodeHandle End;
+	};
+
+	static constexpr int32 MaxFloodedComponents = 4;
+	//Bigger floods are not kept. Their sets would take more memory than searching them again saves.
+	static constexpr int32 MaxFloodedLeaves = 16384;
+	TArray<FFloodedComponent> FloodedComponents;
+	uint32 FloodedRevision = 0;
+
+private:
+	struct FBrood
+	{
+		OctreeNode Nodes[8];
+	};
+
+	static constexpr int32 BroodsPerSlab = 256;
+	static constexpr int32 PathfindingDataPerSlab = 1024;
+
+	void AddBroodSlab();
+	void AddPathfindingDataSlab();
+	bool IsCustomBlock(const OctreeNode* Children) const;
+
+	//Latest stamp of the children if they are all leaves, the only broods eviction frees. False otherwise.
+	static bool GetLeafBroodEpoch(const OctreeNode& Node, uint64& OutEpoch);
+
+	//Drops the flooded components that hold any of the node's children, before they are evicted.
+	void ForgetFloodedComponents(OctreeNode& Parent);
+
+	//A node whose children are all leaves, with their latest stamp when it was found.
+	struct FEvictionCandidate
+	{
+		FOctreeNodeHandle Parent;
+		uint64 Epoch = 0;
+
+		//For the heap, least recently used first.
+		bool operator<(const FEvictionCandidate& Other) const { return Epoch < Other.Epoch; }
+	};
+
+	//Heap of the candidates, filled by walking the tree with EvictionScan. Both carry over between calls of EvictOverBudget().
+	TArray<FEvictionCandidate> EvictionCandidates;
+	TArray<FOctreeNodeHandle> EvictionScan;
+
+	OctreeNode Root;
+
+	TArray<FBrood*> BroodSlabs;
+	TArray<FBrood*> FreeBroods;
+
+	TArray<FPathfindingNode*> PathfindingDataSlabs;
+	TArray<FPathfindingNode*> FreePathfindingData;
+
+	TArray<TArray<OctreeNode>> CustomBlocks;
+
+	int32 LiveNodeCount = 1;
+	int32 LivePathfindingDataCount = 0;
+
+	static constexpr int32 MaxReaders = 32;
+	//Epoch of the search in each slot, 0 for a free slot.
+	std::atomic<uint64> ReaderEpochs[MaxReaders] = {};
+	std::atomic<uint64> NextEpoch = 1;
+};
+
+//Holds the arena's epoch for as long as it lives, see FOctreeNodeArena::EnterEpoch().
+class FOctreeEpochScope
+{
+public:
+	FOctreeEpochScope(FOctreeNodeArena& InArena, const uint64 Epoch) : Arena(InArena), Reader(InArena.EnterEpoch(Epoch)) {}
+	~FOctreeEpochScope() { Arena.LeaveEpoch(Reader); }
+
+	FOctreeEpochScope(const FOctreeEpochScope&) = delete;
+	FOctreeEpochScope& operator=(const FOctreeEpochScope&) = delete;
+
+private:
+	FOctreeNodeArena& Arena;
+	const int32 Reader;
+};
@@ -8,6 +8,7 @@
 #include "Octree.h"
 #include "Components/ActorComponent.h"
 #include "GameFramework/FloatingPawnMovement.h"
+#include "WorldCollision.h"
 #include "OctreePathfindingComponent.generated.h"
 
 
@@ -57,7 +58,8 @@ public:
 		
 		OctreeWeakPtr = NewOctree;
 		CollisionChannel = NewOctree->GetCollisionChannel();
-		PathfindingRunnable = NewOctree->GetPathfindingRunnable();
+		SearchGraph = NewOctree->GetSearchGraph();
+		FlowField = NewOctree->GetFlowField();
 	}
 
 	UPROPERTY(BlueprintReadWrite, EditAnywhere,  Category="Pathfinding")
@@ -65,7 +67,13 @@ public:
 
 private:
 	FVector PathSmoothing(const FVector& Start, const AActor* TargetActor, const TArray<FVector>& Path) const;
+	//Same as PathSmoothing(), with all sweeps of the path submitted at once. The physics scene runs them during the frame,
+	//and OnSmoothingSweepDone() picks the next location once they are all back, at the start of the next one.
+	void SubmitSmoothingSweeps(const FVector& Start, const AActor* TargetActor, const TArray<FVector>& Path);
+	void OnSmoothingSweepDone(const FTraceHandle& Handle, FTraceDatum& Datum);
 	void GetAStarPathAsync(const AActor* TargetActor, FVector& TargetLocation, FVector& OutNextDirection);
+	void OnPathFound(FPathfindingResult& Result);
+	void CancelPathRequest();
 
 	UPROPERTY()
 	UFloatingPawnMovement* MovementComponent = nullptr;
@@ -82,6 +90,26 @@ private:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Pathfinding", meta = (AllowPrivateAccess = "true",  ClampMin = 0))
 	float StraightMovementSpeed = 1755;
 
+	//Requests with a higher priority are searched before the ones of other agents.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Pathfinding", meta = (AllowPrivateAccess = "true"))
+	int32 PathfindingPriority = 0;
+
+	//Seconds a request may wait in the queue and search for. 0 for no limit.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Pathfinding", meta = (AllowPrivateAccess = "true",  ClampMin = 0))
+	float PathRequestTimeout = 0.5f;
+
+	//Smooths paths with raycasts through the octree instead of physics sweeps. Much cheaper, but blind to anything the octree was not built from.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Pathfinding", meta = (AllowPrivateAccess = "true"))
+	bool UseOctreeLineOfSight = false;
+
+	//Smooths paths with async sweeps, so the game thread never waits on them. The smoothed direction comes in a frame later.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Pathfinding", meta = (AllowPrivateAccess = "true", EditCondition = "!UseOctreeLineOfSight"))
+	bool UseAsyncPathSmoothing = false;
+
+	//Async smoothing sweeps every point up front instead of stopping at the first hit, so only this many points ahead are tried.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Pathfinding", meta = (AllowPrivateAccess = "true", ClampMin = 2, ClampMax = 255, EditCondition = "UseAsyncPathSmoothing"))
+	int32 MaxSmoothingSweeps = 16;
+
 	
 
 	UPROPERTY(EditAnywhere, Category="Pathfinding",
@@ -92,7 +120,18 @@ private:
 
 	
 	TWeakObjectPtr<AOctree> OctreeWeakPtr;
-	TWeakPtr<FPathfindingWorker> PathfindingRunnable;
+	TWeakPtr<FOctreeSearchGraph> SearchGraph;
+	FPathfindingRequestHandle PathRequest;
+	//Set by OnPathFound(), the path is smoothed the next time the direction is asked for.
+	bool HasNewPath = false;
+
+	//The batch of async smoothing sweeps in flight. Sweep i goes from the start to SweepPoints[i + 1].
+	TArray<FVector> SweepPoints;
+	TBitArray<> SweepBlocked;
+	int32 SweepsLeft = 0;
+	//Goes into the user data of the sweeps, so the ones of an older batch are ignored.
+	uint32 SweepBatch = 0;
+	TWeakPtr<FLinearOctreeFlowField> FlowField;
 	ECollisionChannel CollisionChannel = ECC_Visibility;
 	
 	bool StopPathfinding = false;
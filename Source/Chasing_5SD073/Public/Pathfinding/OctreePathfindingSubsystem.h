@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PathfindingService.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "OctreePathfindingSubsystem.generated.h"
+
+/**
+ * Owns the pathfinding service of the world, shared by every octree in it, and calls the completion delegates of its requests
+ * on the game thread every tick.
+ */
+UCLASS()
+class CHASING_5SD073_API UOctreePathfindingSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	FPathfindingService& GetService() const { return *Service; }
+
+private:
+	TUniquePtr<FPathfindingService> Service;
+};
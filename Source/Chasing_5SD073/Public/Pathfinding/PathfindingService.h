@@ -0,0 +1,258 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "OctreeGraph.h"
+
+class FPathfindingWorker;
+
+namespace PathfindingService
+{
+	//Upper bound of the worker pool.
+	inline constexpr int32 MaxWorkers = 16;
+}
+
+struct FPathfindingRequestHandle
+{
+	uint64 Id = 0;
+
+	bool IsValid() const { return Id != 0; }
+	void Reset() { Id = 0; }
+};
+
+enum class EPathfindingStatus : uint8
+{
+	//A complete path, or a partial one if the search ran out of budget.
+	Found,
+	NotFound,
+	//Still in the queue when its deadline passed, it was never searched.
+	Expired
+};
+
+struct FPathfindingResult
+{
+	FPathfindingRequestHandle Handle;
+	EPathfindingStatus Status = EPathfindingStatus::NotFound;
+	TArray<FVector> Path;
+	//False for a path an anytime search hands out before it goes on improving it. The request is still running, and can still be cancelled.
+	bool Done = true;
+};
+
+//Called on the game thread. Cancelled and replaced requests never call it.
+//The path is a buffer of the service. Swapping it with a buffer of the receiver gets the path without copying it, the receiver's old
+//buffer is then reused for a later result.
+DECLARE_DELEGATE_OneParam(FOnPathfindingComplete, FPathfindingResult&);
+
+/* What requests are searched on: the data of one octree, whichever backend it uses, and the settings it is searched with.
+ *
+ * Requests hold it shared, so it outlives its octree actor until the last search on it is done.
+ * The search states (contexts and scratch memory, with the trees kept for incremental replanning) belong to the agents, not to the
+ * workers. Whichever worker takes an agent's request carries on that agent's tree, so the trees still resume with many agents
+ * interleaving on the pool.
+ */
+struct CHASING_5SD073_API FOctreeSearchGraph
+{
+	//Pointer backend.
+	TSharedPtr<FOctreeNodeArena> NodeArena;
+	FOctreeBoxIndex ActorBoxes;
+	float MinSize = 0;
+
+	//Linear backend, with an optional hierarchy. Declared after the octree it points into, so it goes first.
+	TSharedPtr<FLinearOctree> LinearOctree;
+	TSharedPtr<FLinearOctreeHierarchy> LinearHierarchy;
+
+	FOctreePathSettings PathSettings;
+	bool Debug = false;
+
+	//Agents that keep a search state of their own. Past it, the state least recently used goes to the next agent. Every state of the
+	//linear backend is sized to its cell count.
+	int32 MaxAgentStates = 16;
+
+	//First thing the segment hits, grown by the radius, on whichever backend the graph has. Any thread holding the graph can call it,
+	//the pointer backend reads its boxes under the occupancy lock. The pointer backend only knows the level boxes, not the leaves.
+	bool Raycast(const FVector& From, const FVector& To, const float Radius, FOctreeRaycastHit& OutHit) const;
+	bool HasLineOfSight(const FVector& From, const FVector& To, const float Radius = 0) const;
+
+	//Up to Count free leaves nearest to the location first, none further than MaxRadius, as boxes whichever the backend. Any thread.
+	void FindNearestFreeLeaves(const FVector& Location, const float MaxRadius, const int32 Count, TArray<FBox>& OutLeaves) const;
+
+	//Searches on the state of the agent, or on any free one for AgentKey 0. Any worker. Stops early once Cancelled is set.
+	bool FindPath(const std::atomic<bool>& Cancelled, const uint64 AgentKey, const FVector& Start, const FVector& End, const FOctreePathSettings& Settings,
+	              TArray<FVector>& OutPath);
+
+	//Boxes of things that move, pointer backend only. Any thread. The changes are only queued, see TryApplyObstacleUpdates().
+	int32 AddObstacle(const FBox& Box);
+	void MoveObstacle(const int32 Id, const FBox& Box);
+	void RemoveObstacle(const int32 Id);
+
+	//Applies the queued obstacle changes if no search is running, without waiting for them. Only the leaves touching the old and
+	//new boxes are classified again, and only the nodes around the ones that changed look for their neighbors again.
+	//The game thread calls it every tick and the searches before they start. False if nothing was applied.
+	bool TryApplyObstacleUpdates();
+
+	//Seconds the obstacle changes may wait for a moment without searches. Past it, the next search waits for the running ones to finish
+	//and applies them, and the searches starting meanwhile wait for that, so a busy pool cannot keep them out.
+	double MaxObstacleDelay = 0.1;
+
+private:
+	struct FObstacleUpdate
+	{
+		int32 Id = INDEX_NONE;
+		FBox Box = FBox(ForceInit);
+		bool Removed = false;
+	};
+
+	//Queues the change and notes when the queue stopped being empty. Must hold ObstacleLock.
+	void QueueObstacleUpdate(const FObstacleUpdate& Update);
+	//Applies the changes once they are overdue, waiting for the running searches. Only from a thread that holds no arena lock.
+	void ApplyOverdueObstacleUpdates();
+	//Must hold the occupancy lock for writing.
+	void ApplyObstacleUpdates();
+
+	//Guards the queue and the ids. The applied boxes live in ActorBoxes, under the arena's occupancy lock.
+	FCriticalSection ObstacleLock;
+	TArray<FObstacleUpdate> PendingObstacles;
+	//So the searches don't take the lock just to find the queue empty.
+	std::atomic<bool> ObstaclesPending = false;
+	//FPlatformTime::Seconds() of the oldest change in the queue.
+	std::atomic<double> ObstaclesPendingSince = 0;
+	//Set while a search waits for the write lock to apply overdue changes.
+	std::atomic<bool> ObstacleWriterWaiting = false;
+	int32 NextObstacleId = 0;
+
+	struct FSearchState
+	{
+		FLazyOctreeSearchContext LazyContext;
+		FLinearOctreeSearchScratch LinearScratch;
+		//Agent whose tree the state keeps, 0 for none.
+		uint64 AgentKey = 0;
+		//Only one search at a time. An agent's next request can be taken while its last one is still searched.
+		bool InUse = false;
+		uint64 LastUse = 0;
+	};
+
+	//The agent's own state if it is free. Otherwise a new one, or the free one least recently used, which starts the agent's tree over.
+	FSearchState& AcquireState(const uint64 AgentKey);
+	void ReleaseState(FSearchState& State);
+
+	//Guards the states and their flags, not what is in them. Held only to hand them out.
+	FCriticalSection StateLock;
+	//Pointers, so a state stays put while it is searched on and the array grows. Never more than MaxAgentStates and the searches running.
+	TArray<TUniquePtr<FSearchState>> States;
+	uint64 NextUse = 0;
+};
+
+/* A pool of worker threads searching the requests of every octree in the world.
+ *
+ * Any thread can submit requests. The queue is ordered by priority first and by age second, and a request can carry a deadline
+ * after which it is dropped instead of searched. Requests from the same agent replace each other while they wait, so an agent never
+ * has more than its newest request queued.
+ *
+ * Every worker hands its results to the game thread through a ring of its own, with one producer and one consumer, so handing over
+ * a result is an atomic index update and no lock. The slots keep their path buffers, and trade them with the worker's for every
+ * result, so once the rings are warm no result allocates or copies anything. An anytime search can hand out several results for
+ * one request, only the paths it improves on the way are copied.
+ */
+class CHASING_5SD073_API FPathfindingService
+{
+public:
+	FPathfindingService();
+	~FPathfindingService();
+
+	FPathfindingService(const FPathfindingService&) = delete;
+	FPathfindingService& operator=(const FPathfindingService&) = delete;
+
+	//Grows the pool to the given number of workers, it never shrinks. Game thread only.
+	void SetWorkerCount(const int32 Count);
+	int32 GetWorkerCount() const { return Workers.Num(); }
+
+	/// @param Timeout Seconds the request may wait and search for, 0 for no deadline.
+	/// @param AgentKey Replaces the request of the same agent that is still queued. 0 for none.
+	FPathfindingRequestHandle Submit(const TSharedPtr<FOctreeSearchGraph>& Graph, const FVector& Start, const FVector& End, FOnPathfindingComplete OnComplete,
+	                                 const int32 Priority = 0, const float Timeout = 0, const uint64 AgentKey = 0);
+
+	//Drops a queued request, or stops its search if it already started. Its delegate will not be called. False if it is already done.
+	bool Cancel(const FPathfindingRequestHandle Handle);
+
+	//Cancels every request on the graph, for octrees that go away.
+	void CancelAll(const FOctreeSearchGraph* Graph);
+
+	//Calls the delegates of the requests done since the last call. Game thread only.
+	void DispatchCompleted();
+
+	//Worker side.
+	struct FRequest
+	{
+		uint64 Id = 0;
+		uint64 AgentKey = 0;
+		int32 Priority = 0;
+		//FPlatformTime::Seconds() after which the request is dropped, 0 for never.
+		double Deadline = 0;
+		FVector Start = FVector::ZeroVector;
+		FVector End = FVector::ZeroVector;
+		TSharedPtr<FOctreeSearchGraph> Graph;
+		FOnPathfindingComplete OnComplete;
+
+		//Doubles as the pause flag of the search, so a cancelled search stops right away.
+		std::atomic<bool> Cancelled = false;
+	};
+
+	struct FResultSlot
+	{
+		TSharedPtr<FRequest> Request;
+		EPathfindingStatus Status = EPathfindingStatus::NotFound;
+		TArray<FVector> Path;
+		bool Done = true;
+	};
+
+	//Blocks until there is a request, null once the service stops.
+	TSharedPtr<FRequest> WaitForRequest();
+
+	//The next slot of the worker's ring, with an empty path that keeps its capacity. Blocks while the ring is full, null once the service stops.
+	FResultSlot* BeginResult(const int32 WorkerIndex);
+	//Hands the slot from BeginResult() over to the game thread. Not done, the request stays outstanding for a later result.
+	void EndResult(const int32 WorkerIndex, const bool Done = true);
+
+private:
+	struct FResultRing
+	{
+		//A power of 2, so the indices can run past it and wrap around on their own.
+		static constexpr uint32 Capacity = 64;
+
+		FResultSlot Slots[Capacity];
+		//Only the worker moves the head, only the game thread moves the tail. Both only ever count up.
+		std::atomic<uint32> Head = 0;
+		std::atomic<uint32> Tail = 0;
+		//Triggered when the game thread frees slots, for a worker waiting on a full ring. Auto reset.
+		FEvent* SpaceEvent = nullptr;
+
+		FResultRing() { SpaceEvent = FPlatformProcess::GetSynchEventFromPool(false); }
+		~FResultRing() { FPlatformProcess::ReturnSynchEventToPool(SpaceEvent); }
+	};
+
+	//Higher priority first, older first within the same priority.
+	static bool ComesFirst(const TSharedPtr<FRequest>& A, const TSharedPtr<FRequest>& B)
+	{
+		return A->Priority != B->Priority ? A->Priority > B->Priority : A->Id < B->Id;
+	}
+
+	TArray<TUniquePtr<FPathfindingWorker>> Workers;
+	//A fixed array, so the game thread adding a ring never moves the one a worker is writing to.
+	TUniquePtr<FResultRing> ResultRings[PathfindingService::MaxWorkers];
+
+	//Guards the queue, the two maps and the ids.
+	FCriticalSection QueueLock;
+	//Heap on ComesFirst. Cancelled requests stay in it until they are popped.
+	TArray<TSharedPtr<FRequest>> Queue;
+	//Queued or being searched, for Cancel().
+	TMap<uint64, TSharedPtr<FRequest>> Outstanding;
+	//The queued request of every agent, for the replacing.
+	TMap<uint64, TSharedPtr<FRequest>> QueuedByAgent;
+	uint64 NextId = 1;
+
+	//Auto reset, shared by all workers. A worker that takes a request wakes the next one if there are more, and one that stops wakes
+	//the next one too, so a single trigger is never lost.
+	FEvent* RequestEvent = nullptr;
+	std::atomic<bool> Running = true;
+};